@@ -0,0 +1,122 @@
+// Simulation throughput of the default and --optimized L1/L2/memory
+// hierarchies, with and without block payloads, on the generic Cache and on
+// the specialized engines from create_cache(), one HandleRequest call per
+// access or HandleBatch calls of 1024, in trace accesses per second.
+//
+// Usage: bench-cache trace-path [iter]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <memory>
+#include "config.hpp"
+#include "cache.hpp"
+#include "memory.hpp"
+#include "trace.hpp"
+
+using namespace std;
+
+static void make_configs(bool optimize, bool tag_only, CacheConfig &l1_config, CacheConfig &l2_config) {
+  l1_config.size = L1_CACHE_SIZE;
+  l1_config.block_size = L1_BLOCK_SIZE;
+  l1_config.associativity = L1_CACHE_LINES;
+  l1_config.write_through = L1_WRITE_THROUGH;
+  l1_config.write_allocate = L1_WRITE_ALLOCATE;
+  l1_config.prefetch = optimize ? 3 : 0;
+  l1_config.replacement = optimize ? "plru" : "lru";
+  l1_config.mct = 0;
+  l1_config.bypass = false;
+  l1_config.bypass_predictor = "mct";
+  l1_config.prefetcher = "next-line";
+  l1_config.prefetch_throttle = false;
+  l1_config.mshrs = 0;
+  l1_config.tag_only = tag_only;
+
+  l2_config.size = L2_CACHE_SIZE;
+  l2_config.block_size = L2_BLOCK_SIZE;
+  l2_config.associativity = L2_CACHE_LINES;
+  l2_config.write_through = L2_WRITE_THROUGH;
+  l2_config.write_allocate = L2_WRITE_ALLOCATE;
+  l2_config.prefetch = optimize ? 3 : 0;
+  l2_config.replacement = "lru";
+  l2_config.mct = optimize ? 1 : 0;
+  l2_config.bypass = optimize;
+  l2_config.bypass_predictor = "mct";
+  l2_config.prefetcher = "next-line";
+  l2_config.prefetch_throttle = false;
+  l2_config.mshrs = 0;
+  l2_config.tag_only = tag_only;
+}
+
+static Cache *make_cache(const CacheConfig &cc, bool specialized) {
+  if (specialized)
+    return create_cache(cc);
+  auto cache = new Cache();
+  cache->SetConfig(cc);
+  return cache;
+}
+
+static double run(const vector<TraceRequest> &requests, bool optimize, bool tag_only, bool specialized,
+                  bool batched, int iter) {
+  CacheConfig l1_config, l2_config;
+  make_configs(optimize, tag_only, l1_config, l2_config);
+  StorageStats stats;
+  memset(&stats, 0, sizeof(stats));
+  unique_ptr<Cache> l1(make_cache(l1_config, specialized));
+  unique_ptr<Cache> l2(make_cache(l2_config, specialized));
+  Memory mem;
+  l1->SetStats(stats);
+  l1->SetLower(l2.get());
+  l1->SetLatency({L1_HIT_LATENCY, L1_BUS_LATENCY});
+  l2->SetStats(stats);
+  l2->SetLower(&mem);
+  l2->SetLatency({L2_HIT_LATENCY, L2_BUS_LATENCY});
+  mem.SetStats(stats);
+  mem.SetLatency({MEM_HIT_LATENCY, MEM_BUS_LATENCY});
+
+  vector<char> buf(l1_config.block_size);
+  vector<AccessRequest> batch;
+  for (auto &req: requests)
+    batch.push_back({req.addr, 1, req.read});
+  vector<AccessResult> results(1024);
+  int hit, time;
+  auto start = chrono::steady_clock::now();
+  for (int i = 0; i < iter; i++) {
+    if (batched) {
+      for (size_t done = 0; done < batch.size(); done += results.size())
+        l1->HandleBatch(&batch[done], min(results.size(), batch.size() - done), buf.data(), results.data());
+      continue;
+    }
+    for (auto &req: requests)
+      l1->HandleRequest(req.addr, 1, req.read, buf.data(), hit, time);
+  }
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s trace-path [iter]\n", argv[0]);
+    return 1;
+  }
+  int iter = argc > 2 ? atoi(argv[2]) : 10;
+  vector<TraceRequest> requests;
+  if (!load_trace(argv[1], requests)) {
+    fprintf(stderr, "Can't open trace %s\n", argv[1]);
+    return 1;
+  }
+  printf("%s: %zu requests x %d iterations\n", argv[1], requests.size(), iter);
+  for (bool batched: {false, true}) {
+    for (bool specialized: {false, true}) {
+      for (bool tag_only: {false, true}) {
+        for (bool optimize: {false, true}) {
+          double seconds = run(requests, optimize, tag_only, specialized, batched, iter);
+          printf("  %-7s %-11s %-9s %-8s: %8.2f M accesses/s  %8.3f ms\n", batched ? "batch" : "single",
+                 specialized ? "specialized" : "generic", optimize ? "optimized" : "default",
+                 tag_only ? "tag-only" : "data", requests.size() * (double) iter / seconds / 1e6, seconds * 1e3);
+        }
+      }
+    }
+  }
+  return 0;
+}
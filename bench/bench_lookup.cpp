@@ -0,0 +1,75 @@
+// Way lookup kernels per associativity: random resident tags, half of the
+// probes hit, a quarter of the lines are invalid.
+//
+// Usage: bench-lookup [probes]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "aligned_allocator.hpp"
+#include "way_lookup.hpp"
+
+using namespace std;
+
+#define LOOKUP_BENCH_SETS 1024
+
+int main(int argc, char *argv[]) {
+  size_t probes = argc > 1 ? atol(argv[1]) : 20000000;
+  mt19937_64 rng(42);
+  printf("%zu probes over %d sets, Mlookups/s\n", probes, LOOKUP_BENCH_SETS);
+  printf("  %-6s", "assoc");
+  for (auto kernel: {kLookupScalar, kLookupSse42, kLookupAvx2}) {
+    if (lookup_kernel_supported(kernel))
+      printf("  %10s", lookup_kernel_name(kernel));
+  }
+  printf("\n");
+
+  int status = 0;
+  for (int assoc = 1; assoc <= 64; assoc <<= 1) {
+    int words = (assoc + 63) / 64;
+    AlignedVector<uint64_t> tags((size_t) LOOKUP_BENCH_SETS * assoc);
+    AlignedVector<uint64_t> valid((size_t) LOOKUP_BENCH_SETS * words, 0);
+    for (auto &tag: tags)
+      tag = rng() & 0xfffff;
+    for (int set = 0; set < LOOKUP_BENCH_SETS; set++) {
+      for (int way = 0; way < assoc; way++) {
+        if (rng() % 4)
+          valid[set * words + way / 64] |= 1ULL << (way % 64);
+      }
+    }
+    // Probe sets and tags up front so the loop only measures the kernel
+    vector<uint32_t> probe_sets(1 << 16);
+    vector<uint64_t> probe_tags(1 << 16);
+    for (size_t i = 0; i < probe_sets.size(); i++) {
+      probe_sets[i] = rng() % LOOKUP_BENCH_SETS;
+      probe_tags[i] = rng() % 2 ? tags[probe_sets[i] * assoc + rng() % assoc] : rng() & 0xfffff;
+    }
+
+    printf("  %-6d", assoc);
+    long expected = 0;
+    for (auto kernel: {kLookupScalar, kLookupSse42, kLookupAvx2}) {
+      if (!lookup_kernel_supported(kernel))
+        continue;
+      auto lookup = way_lookup(kernel);
+      long checksum = 0;
+      auto start = chrono::steady_clock::now();
+      for (size_t i = 0; i < probes; i++) {
+        size_t j = i & (probe_sets.size() - 1);
+        uint32_t set = probe_sets[j];
+        checksum += lookup(&tags[set * assoc], &valid[set * words], assoc, probe_tags[j]);
+      }
+      double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+      printf("  %10.1f", probes / seconds / 1e6);
+      if (kernel == kLookupScalar)
+        expected = checksum;
+      else if (checksum != expected)
+        status = 1;
+    }
+    printf("\n");
+  }
+  if (status)
+    fprintf(stderr, "kernels disagree with the scalar lookup\n");
+  return status;
+}
@@ -0,0 +1,109 @@
+// Text trace ingestion throughput: the original ifstream loop against the
+// mmap parser with every hex kernel the host supports.
+//
+// Usage: bench-parse trace-path [repeat] [threads]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <fstream>
+#include "mapped_file.hpp"
+#include "text_trace.hpp"
+#include "thread_pool.hpp"
+
+using namespace std;
+
+static double now_seconds() {
+  return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void parse_ifstream(const char *path, vector<TraceRequest> &requests) {
+  ifstream fi;
+  fi.open(path);
+  char op;
+  uint64_t addr;
+  requests.clear();
+  while (fi >> op >> hex >> addr) {
+    requests.push_back({addr, op == 'r'});
+  }
+}
+
+static bool same_requests(const vector<TraceRequest> &a, const vector<TraceRequest> &b) {
+  if (a.size() != b.size())
+    return false;
+  for (size_t i = 0; i < a.size(); i++) {
+    if (a[i].addr != b[i].addr || a[i].read != b[i].read)
+      return false;
+  }
+  return true;
+}
+
+static void report(const char *name, size_t lines, double seconds, double baseline) {
+  printf("  %-10s: %10.2f Mlines/s  %8.3f ms  %6.2fx\n", name, lines / seconds / 1e6, seconds * 1e3,
+         baseline / seconds);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s trace-path [repeat]\n", argv[0]);
+    return 1;
+  }
+  const char *path = argv[1];
+  int repeat = argc > 2 ? atoi(argv[2]) : 5;
+  int threads = argc > 3 ? atoi(argv[3]) : hardware_threads();
+
+  vector<TraceRequest> expected, requests;
+  double start, baseline = 1e30;
+  for (int i = 0; i < repeat; i++) {
+    start = now_seconds();
+    parse_ifstream(path, expected);
+    baseline = min(baseline, now_seconds() - start);
+  }
+  if (expected.empty()) {
+    fprintf(stderr, "Can't read trace %s\n", path);
+    return 1;
+  }
+
+  printf("%s: %zu lines, best of %d runs\n", path, expected.size(), repeat);
+  report("ifstream", expected.size(), baseline, baseline);
+
+  MappedFile file;
+  if (!file.Open(path)) {
+    fprintf(stderr, "Can't map trace %s\n", path);
+    return 1;
+  }
+  int status = 0;
+  for (auto kernel: {kHexScalar, kHexSsse3, kHexAvx2}) {
+    if (!hex_kernel_supported(kernel))
+      continue;
+    double best = 1e30;
+    for (int i = 0; i < repeat; i++) {
+      start = now_seconds();
+      requests.clear();
+      parse_text_trace(file.Data(), file.Data() + file.Size(), requests, kernel);
+      best = min(best, now_seconds() - start);
+    }
+    report(hex_kernel_name(kernel), requests.size(), best, baseline);
+    if (!same_requests(expected, requests)) {
+      fprintf(stderr, "%s kernel disagrees with ifstream\n", hex_kernel_name(kernel));
+      status = 1;
+    }
+  }
+
+  // Chunked parsing, small traces fall back to a single chunk
+  double best = 1e30;
+  for (int i = 0; i < repeat; i++) {
+    start = now_seconds();
+    requests.clear();
+    parse_text_trace_parallel(file.Data(), file.Data() + file.Size(), requests, best_hex_kernel(), threads);
+    best = min(best, now_seconds() - start);
+  }
+  char name[32];
+  snprintf(name, sizeof(name), "%d threads", threads);
+  report(name, requests.size(), best, baseline);
+  if (!same_requests(expected, requests)) {
+    fprintf(stderr, "parallel parser disagrees with ifstream\n");
+    status = 1;
+  }
+  return status;
+}
@@ -0,0 +1,101 @@
+// Validation of set sampling against full simulation: for each trace and
+// sample rate, the scaled estimates with their 95% confidence intervals next
+// to the exact values, whether the interval covers them, and the speedup.
+//
+// Usage: bench-sampling iter trace-path...
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <cmath>
+#include "shard.hpp"
+
+using namespace std;
+
+static double seconds_since(chrono::steady_clock::time_point start) {
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static double l1_misses(const Hierarchy &h) {
+  StorageStats stats;
+  h.L1()->GetStats(stats);
+  return stats.miss_num;
+}
+
+static double l1_accesses(const Hierarchy &h) {
+  StorageStats stats;
+  h.L1()->GetStats(stats);
+  return stats.access_counter;
+}
+
+static double l2_misses(const Hierarchy &h) {
+  StorageStats stats;
+  h.L2()->GetStats(stats);
+  return stats.miss_num;
+}
+
+static double l2_accesses(const Hierarchy &h) {
+  StorageStats stats;
+  h.L2()->GetStats(stats);
+  return stats.access_counter;
+}
+
+static double total_time(const Hierarchy &h) {
+  return h.GetStats().time;
+}
+
+static void report(const char *name, const SampleInterval &interval, double exact) {
+  bool covered = fabs(interval.value - exact) <= interval.half_width;
+  printf("    %-13s %12.6g +- %-10.4g exact %12.6g  error %+7.2f%%  %s\n", name, interval.value,
+         interval.half_width, exact, exact ? (interval.value - exact) / exact * 100 : 0.0,
+         covered ? "covered" : "MISSED");
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    fprintf(stderr, "Usage: %s iter trace-path...\n", argv[0]);
+    return 1;
+  }
+  int iter = atoi(argv[1]);
+  CacheConfig l1, l2;
+  preset_configs(false, true, l1, l2);
+  int shards = max_shards(l1, l2);
+
+  for (int t = 2; t < argc; t++) {
+    vector<TraceRequest> requests;
+    if (!load_trace(argv[t], requests)) {
+      fprintf(stderr, "Can't open trace %s\n", argv[t]);
+      return 1;
+    }
+    Hierarchy full;
+    full.Init(l1, l2);
+    auto start = chrono::steady_clock::now();
+    full.Run(requests, iter);
+    double full_seconds = seconds_since(start);
+    printf("%s: %zu requests x %d iterations, %d shards, full run %.3f s\n", argv[t], requests.size(), iter,
+           shards, full_seconds);
+
+    for (double rate: {0.5, 0.25, 0.125}) {
+      ShardedHierarchy sampled;
+      if (!sampled.Init(l1, l2, shards, rate)) {
+        fprintf(stderr, "Can't sample %d shards\n", shards);
+        return 1;
+      }
+      start = chrono::steady_clock::now();
+      sampled.Run(requests, iter, 1);
+      double seconds = seconds_since(start);
+      printf("  rate %.3f (%d/%d shards): %.3f s, %.2fx\n", rate, sampled.Sampled(), shards, seconds,
+             full_seconds / seconds);
+      auto &total = full.GetStats();
+      report("Miss rate", sampled.RatioInterval([](const Hierarchy &h) {
+        return (double) (h.GetStats().request_num - h.GetStats().hit_num);
+      }, [](const Hierarchy &h) {
+        return (double) h.GetStats().request_num;
+      }), (double) (total.request_num - total.hit_num) / total.request_num);
+      report("L1 miss rate", sampled.RatioInterval(l1_misses, l1_accesses), l1_misses(full) / l1_accesses(full));
+      report("L2 miss rate", sampled.RatioInterval(l2_misses, l2_accesses), l2_misses(full) / l2_accesses(full));
+      report("Total time", sampled.TotalInterval(total_time), total_time(full));
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,46 @@
+// Sweep throughput over a 16 point L1 size x associativity grid as the
+// worker count doubles, in simulated hierarchies and accesses per second.
+//
+// Usage: bench-sweep trace-path [iter] [max-threads]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include "sweep.hpp"
+#include "thread_pool.hpp"
+
+using namespace std;
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s trace-path [iter] [max-threads]\n", argv[0]);
+    return 1;
+  }
+  int iter = argc > 2 ? atoi(argv[2]) : 2;
+  int max_threads = argc > 3 ? atoi(argv[3]) : hardware_threads();
+  vector<TraceRequest> requests;
+  if (!load_trace(argv[1], requests)) {
+    fprintf(stderr, "Can't open trace %s\n", argv[1]);
+    return 1;
+  }
+
+  CacheConfig l1, l2;
+  preset_configs(false, true, l1, l2);
+  auto base = two_level_config(l1, l2);
+  vector<SweepPoint> points;
+  expand_sweep_grid(base, {"l1.size=8K,16K,32K,64K", "l1.assoc=2,4,8,16"}, points);
+  printf("%s: %zu requests x %d iterations x %zu configs\n", argv[1], requests.size(), iter, points.size());
+
+  double base_seconds = 0;
+  for (int threads = 1; threads <= max_threads; threads *= 2) {
+    vector<SweepResult> results;
+    auto start = chrono::steady_clock::now();
+    run_sweep(requests, iter, points, threads, results);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (threads == 1)
+      base_seconds = seconds;
+    printf("  %2d threads: %8.2f configs/s  %8.2f M accesses/s  %5.2fx\n", threads, points.size() / seconds,
+           points.size() * requests.size() * (double) iter / seconds / 1e6, base_seconds / seconds);
+  }
+  return 0;
+}
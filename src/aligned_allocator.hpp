@@ -0,0 +1,46 @@
+#ifndef CACHE_ALIGNED_ALLOCATOR_H_
+#define CACHE_ALIGNED_ALLOCATOR_H_
+
+#include <stddef.h>
+#include <new>
+#include <vector>
+
+using namespace std;
+
+#define HOST_CACHE_LINE 64
+
+// Allocator handing out storage aligned to Align bytes
+template <typename T, size_t Align = HOST_CACHE_LINE>
+struct AlignedAllocator {
+  typedef T value_type;
+
+  template <typename U>
+  struct rebind {
+    typedef AlignedAllocator<U, Align> other;
+  };
+
+  AlignedAllocator() {}
+
+  template <typename U>
+  AlignedAllocator(const AlignedAllocator<U, Align> &) {}
+
+  T *allocate(size_t n) {
+    return static_cast<T *>(::operator new(n * sizeof(T), align_val_t(Align)));
+  }
+
+  void deallocate(T *p, size_t) {
+    ::operator delete(p, align_val_t(Align));
+  }
+
+  template <typename U>
+  bool operator==(const AlignedAllocator<U, Align> &) const { return true; }
+
+  template <typename U>
+  bool operator!=(const AlignedAllocator<U, Align> &) const { return false; }
+};
+
+// vector whose data starts on a host cache line
+template <typename T>
+using AlignedVector = vector<T, AlignedAllocator<T>>;
+
+#endif //CACHE_ALIGNED_ALLOCATOR_H_
@@ -0,0 +1,149 @@
+#include <string.h>
+#include "binary_trace.hpp"
+
+static void encode_header(const BinaryTraceHeader &header, uint8_t *p) {
+  memcpy(p, BINARY_TRACE_MAGIC, 8);
+  put_u32(p + 8, header.version);
+  put_u32(p + 12, header.block_requests);
+  put_u64(p + 16, header.request_num);
+  put_u64(p + 24, header.block_num);
+  put_u64(p + 32, header.index_offset);
+}
+
+bool is_binary_trace(const string &path) {
+  char magic[8];
+  FILE *f = fopen(path.c_str(), "rb");
+  if (!f)
+    return false;
+  bool ok = fread(magic, 1, 8, f) == 8 && memcmp(magic, BINARY_TRACE_MAGIC, 8) == 0;
+  fclose(f);
+  return ok;
+}
+
+bool BinaryTraceWriter::Open(const string &path) {
+  Close();
+  file_ = fopen(path.c_str(), "wb");
+  if (!file_)
+    return false;
+  prev_ = 0;
+  request_num_ = 0;
+  block_count_ = 0;
+  block_.clear();
+  index_.clear();
+  // Placeholder header, rewritten by Close() once the counts are known
+  uint8_t header[BINARY_TRACE_HEADER_SIZE] = {0};
+  offset_ = fwrite(header, 1, sizeof(header), file_);
+  return offset_ == sizeof(header);
+}
+
+void BinaryTraceWriter::Append(uint64_t addr, bool read) {
+  uint8_t record[BINARY_TRACE_MAX_RECORD];
+  int len = encode_trace_record(prev_, addr, read, record);
+  block_.insert(block_.end(), record, record + len);
+  prev_ = addr;
+  request_num_++;
+  if (++block_count_ == BINARY_TRACE_BLOCK_REQUESTS)
+    FlushBlock();
+}
+
+bool BinaryTraceWriter::FlushBlock() {
+  if (!block_count_)
+    return true;
+  index_.push_back(offset_);
+  bool ok = fwrite(block_.data(), 1, block_.size(), file_) == block_.size();
+  offset_ += block_.size();
+  block_.clear();
+  block_count_ = 0;
+  prev_ = 0;
+  return ok;
+}
+
+bool BinaryTraceWriter::Close() {
+  if (!file_)
+    return true;
+  bool ok = FlushBlock();
+
+  BinaryTraceHeader header;
+  header.version = BINARY_TRACE_VERSION;
+  header.block_requests = BINARY_TRACE_BLOCK_REQUESTS;
+  header.request_num = request_num_;
+  header.block_num = index_.size();
+  header.index_offset = offset_;
+
+  uint8_t buf[BINARY_TRACE_HEADER_SIZE];
+  for (auto offset: index_) {
+    put_u64(buf, offset);
+    ok = ok && fwrite(buf, 1, 8, file_) == 8;
+  }
+  encode_header(header, buf);
+  ok = ok && fseek(file_, 0, SEEK_SET) == 0;
+  ok = ok && fwrite(buf, 1, sizeof(buf), file_) == sizeof(buf);
+  ok = fclose(file_) == 0 && ok;
+  file_ = nullptr;
+  return ok;
+}
+
+bool BinaryTraceReader::Open(const string &path) {
+  if (!file_.Open(path))
+    return false;
+  auto data = reinterpret_cast<const uint8_t *>(file_.Data());
+  size_t size = file_.Size();
+  if (size < BINARY_TRACE_HEADER_SIZE || memcmp(data, BINARY_TRACE_MAGIC, 8) != 0)
+    return false;
+
+  header_.version = get_u32(data + 8);
+  header_.block_requests = get_u32(data + 12);
+  header_.request_num = get_u64(data + 16);
+  header_.block_num = get_u64(data + 24);
+  header_.index_offset = get_u64(data + 32);
+  if (header_.version != BINARY_TRACE_VERSION || header_.block_requests == 0)
+    return false;
+  uint64_t expected_blocks = (header_.request_num + header_.block_requests - 1) / header_.block_requests;
+  if (header_.block_num != expected_blocks)
+    return false;
+  if (header_.index_offset < BINARY_TRACE_HEADER_SIZE || header_.index_offset > size ||
+      (size - header_.index_offset) / 8 < header_.block_num)
+    return false;
+  uint64_t prev_offset = BINARY_TRACE_HEADER_SIZE;
+  for (uint64_t i = 0; i < header_.block_num; i++) {
+    auto offset = get_u64(data + header_.index_offset + 8 * i);
+    if (offset < prev_offset || offset >= header_.index_offset)
+      return false;
+    prev_offset = offset + 1;
+  }
+  Rewind();
+  return true;
+}
+
+const uint8_t *BinaryTraceReader::Block(uint64_t idx) {
+  auto data = reinterpret_cast<const uint8_t *>(file_.Data());
+  return data + get_u64(data + header_.index_offset + 8 * idx);
+}
+
+bool BinaryTraceReader::SeekBlock(uint64_t idx) {
+  next_block_ = idx + 1;
+  if (idx >= header_.block_num) {
+    left_ = 0;
+    next_block_ = header_.block_num;
+    return false;
+  }
+  auto data = reinterpret_cast<const uint8_t *>(file_.Data());
+  cursor_ = Block(idx);
+  end_ = idx + 1 < header_.block_num ? Block(idx + 1) : data + header_.index_offset;
+  prev_ = 0;
+  left_ = idx + 1 < header_.block_num ? header_.block_requests
+                                      : header_.request_num - idx * header_.block_requests;
+  return true;
+}
+
+bool load_binary_trace(const string &path, vector<TraceRequest> &requests) {
+  BinaryTraceReader reader;
+  if (!reader.Open(path))
+    return false;
+  requests.clear();
+  requests.reserve(reader.Size());
+  TraceRequest req;
+  while (reader.Next(req))
+    requests.push_back(req);
+  return requests.size() == reader.Size();
+}
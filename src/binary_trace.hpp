@@ -0,0 +1,172 @@
+#ifndef CACHE_BINARY_TRACE_H_
+#define CACHE_BINARY_TRACE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "mapped_file.hpp"
+#include "trace.hpp"
+
+using namespace std;
+
+// Binary trace layout, all integers little-endian:
+//   header   magic, version, requests per block, request/block counts, index offset
+//   blocks   varint records, the delta base restarts at 0 in every block
+//   index    one uint64_t byte offset per block
+// A record is the zigzag address delta with the write bit in front of it:
+// the first byte holds [more:1][delta:6][write:1], the following bytes are a
+// plain LEB128 continuation of the remaining delta bits.
+#define BINARY_TRACE_MAGIC "CSTRACE"
+#define BINARY_TRACE_VERSION 1
+#define BINARY_TRACE_HEADER_SIZE 40
+#define BINARY_TRACE_BLOCK_REQUESTS 4096
+#define BINARY_TRACE_MAX_RECORD 10
+
+typedef struct BinaryTraceHeader_ {
+  uint32_t version;
+  uint32_t block_requests; // Requests per block, the last block may be shorter
+  uint64_t request_num;
+  uint64_t block_num;
+  uint64_t index_offset; // Byte offset of the block index
+} BinaryTraceHeader;
+
+// Little-endian integers of the binary file headers
+inline void put_u32(uint8_t *p, uint32_t x) {
+  for (int i = 0; i < 4; i++)
+    p[i] = x >> (8 * i);
+}
+
+inline void put_u64(uint8_t *p, uint64_t x) {
+  for (int i = 0; i < 8; i++)
+    p[i] = x >> (8 * i);
+}
+
+inline uint32_t get_u32(const uint8_t *p) {
+  uint32_t x = 0;
+  for (int i = 0; i < 4; i++)
+    x |= (uint32_t) p[i] << (8 * i);
+  return x;
+}
+
+inline uint64_t get_u64(const uint8_t *p) {
+  uint64_t x = 0;
+  for (int i = 0; i < 8; i++)
+    x |= (uint64_t) p[i] << (8 * i);
+  return x;
+}
+
+// Append one record to out, returns its length in bytes
+inline int encode_trace_record(uint64_t prev, uint64_t addr, bool read, uint8_t *out) {
+  uint64_t delta = addr - prev;
+  uint64_t zz = (delta << 1) ^ (uint64_t) ((int64_t) delta >> 63);
+  uint8_t byte = (read ? 0 : 1) | (uint8_t) ((zz & 0x3f) << 1);
+  zz >>= 6;
+  int len = 0;
+  while (zz) {
+    out[len++] = byte | 0x80;
+    byte = zz & 0x7f;
+    zz >>= 7;
+  }
+  out[len++] = byte;
+  return len;
+}
+
+// Decode one record starting at p, returns the next record or nullptr if it runs past end
+inline const uint8_t *decode_trace_record(const uint8_t *p, const uint8_t *end, uint64_t &prev, TraceRequest &req) {
+  if (p >= end)
+    return nullptr;
+  uint8_t byte = *p++;
+  req.read = !(byte & 1);
+  uint64_t zz = (byte >> 1) & 0x3f;
+  int shift = 6;
+  while (byte & 0x80) {
+    if (p >= end || shift > 63)
+      return nullptr;
+    byte = *p++;
+    zz |= (uint64_t) (byte & 0x7f) << shift;
+    shift += 7;
+  }
+  prev += (zz >> 1) ^ (0 - (zz & 1));
+  req.addr = prev;
+  return p;
+}
+
+// Returns true if path starts with the binary trace magic
+bool is_binary_trace(const string &path);
+
+// Streams requests into a binary trace, blocks are flushed as they fill up
+class BinaryTraceWriter {
+ public:
+  BinaryTraceWriter() : file_(nullptr), prev_(0), request_num_(0), offset_(0) {}
+  ~BinaryTraceWriter() { Close(); }
+
+  bool Open(const string &path);
+
+  void Append(uint64_t addr, bool read);
+
+  // Writes the last block, the index and the final header
+  bool Close();
+
+ private:
+  bool FlushBlock();
+
+  FILE *file_;
+  uint64_t prev_;
+  uint64_t request_num_;
+  uint64_t offset_;
+  int block_count_; // Requests in the current block
+  vector<uint8_t> block_;
+  vector<uint64_t> index_;
+  DISALLOW_COPY_AND_ASSIGN(BinaryTraceWriter);
+};
+
+// Zero-copy reader decoding records straight out of the mapped file
+class BinaryTraceReader {
+ public:
+  BinaryTraceReader() : cursor_(nullptr), end_(nullptr), prev_(0), left_(0), next_block_(0) {}
+  ~BinaryTraceReader() {}
+
+  // Map and validate path, returns false if it isn't a well-formed binary trace
+  bool Open(const string &path);
+
+  void GetHeader(BinaryTraceHeader &header) { header = header_; }
+
+  uint64_t Size() const { return header_.request_num; }
+
+  // Restart decoding from block idx
+  bool SeekBlock(uint64_t idx);
+
+  void Rewind() { SeekBlock(0); }
+
+  // Decode the next request, returns false at the end of the trace
+  inline bool Next(TraceRequest &req) {
+    if (!left_ && !SeekBlock(next_block_))
+      return false;
+    cursor_ = decode_trace_record(cursor_, end_, prev_, req);
+    if (!cursor_) { // truncated block
+      left_ = 0;
+      next_block_ = header_.block_num;
+      return false;
+    }
+    left_--;
+    return true;
+  }
+
+ private:
+  const uint8_t *Block(uint64_t idx);
+
+  MappedFile file_;
+  BinaryTraceHeader header_;
+  const uint8_t *cursor_;
+  const uint8_t *end_;
+  uint64_t prev_;
+  uint64_t left_; // Requests left in the current block
+  uint64_t next_block_;
+  DISALLOW_COPY_AND_ASSIGN(BinaryTraceReader);
+};
+
+// Decode a whole binary trace into requests
+bool load_binary_trace(const string &path, vector<TraceRequest> &requests);
+
+#endif //CACHE_BINARY_TRACE_H_
@@ -0,0 +1,78 @@
+#include "bypass.hpp"
+
+void BypassPredictor::Reset(int set_num, int associativity, int block_size) {
+  set_num_ = set_num;
+  assoc_ = associativity;
+  block_bits_ = __builtin_ctz(block_size);
+  lines_.assign((size_t) set_num * associativity, 0);
+  bypassed_.Reset(set_num, associativity);
+}
+
+bool BypassPredictor::OnMiss(uint64_t set_idx, uint64_t tag, bool full, StorageStats &stats) {
+  if (bypassed_.Contains(set_idx, tag)) {
+    stats.bypass_miss_num++;
+    bypassed_.Erase(set_idx, tag);
+  }
+  if (!full || !Predict(set_idx, tag))
+    return false;
+  stats.bypass_num++;
+  bypassed_.Push(set_idx, tag);
+  return true;
+}
+
+void BypassPredictor::OnEvict(uint64_t set_idx, int line_idx, uint64_t tag, StorageStats &stats) {
+  auto flags = lines_[Index(set_idx, line_idx)];
+  if ((flags & kLineKept) && !(flags & kLineReused))
+    stats.dead_num++;
+  Train(set_idx, tag, flags & kLineReused);
+}
+
+uint64_t BypassPredictor::SetStateHash(uint64_t set_idx, const int *lines) const {
+  uint64_t hash = bypassed_.Hash(set_idx);
+  for (int i = 0; i < assoc_; i++)
+    hash = state_hash_step(hash, lines_[Index(set_idx, lines[i])]);
+  return state_hash_step(hash, PredictorSetHash(set_idx));
+}
+
+void MctPredictor::Reset(int set_num, int associativity, int block_size) {
+  BypassPredictor::Reset(set_num, associativity, block_size);
+  victims_.Reset(set_num, size_ > 0 ? size_ : 0);
+}
+
+void CounterPredictor::Reset(int set_num, int associativity, int block_size) {
+  BypassPredictor::Reset(set_num, associativity, block_size);
+  counters_.assign(BYPASS_TABLE_SIZE, initial_);
+  predicted_ = 0;
+}
+
+uint64_t CounterPredictor::SharedStateHash() const {
+  uint64_t hash = predicted_ % BYPASS_LEARN_PERIOD;
+  for (auto counter: counters_)
+    hash = state_hash_step(hash, counter);
+  return hash;
+}
+
+bool CounterPredictor::Predict(uint64_t set_idx, uint64_t tag) {
+  return Dead(Counter(set_idx, tag)) && ++predicted_ % BYPASS_LEARN_PERIOD != 0;
+}
+
+void ProbabilisticPredictor::Reset(int set_num, int associativity, int block_size) {
+  BypassPredictor::Reset(set_num, associativity, block_size);
+  state_ = 0x2545f4914f6cdd1dULL;
+}
+
+BypassPredictor *create_bypass_predictor(const string &name, int mct_size) {
+  if (name == "mct")
+    return new MctPredictor(mct_size);
+  if (name == "dead-block")
+    return new DeadBlockPredictor();
+  if (name == "signature")
+    return new SignaturePredictor();
+  if (name == "probabilistic")
+    return new ProbabilisticPredictor();
+  return nullptr;
+}
+
+const char *bypass_predictor_names() {
+  return "mct, dead-block, signature, probabilistic";
+}
@@ -0,0 +1,198 @@
+#ifndef CACHE_BYPASS_H_
+#define CACHE_BYPASS_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "storage.hpp"
+#include "state_hash.hpp"
+#include "tag_ring.hpp"
+
+using namespace std;
+
+#define BYPASS_TABLE_SIZE 4096 // Counters of the dead-block and signature predictors, a power of two
+#define BYPASS_REGION_BITS 12 // Address bits below the signature of a block, one 4KB page
+#define BYPASS_LEARN_PERIOD 32 // One in this many bypass predictions fills anyway, so the counters keep learning
+
+// Decides whether a miss fills the cache or leaves it untouched. Cache asks
+// on every miss while bypassing is on and only a full set may be bypassed.
+// The base class tracks whether each line was hit since its fill and the
+// recent bypasses of each set to account the decisions in StorageStats:
+// a bypass was wrong if its block misses again within the next assoc
+// bypasses of the set, a fill in a full set was dead if the line is evicted
+// without a hit. The predictors train on every eviction of a full set.
+class BypassPredictor {
+ public:
+  BypassPredictor() : set_num_(0), assoc_(0), block_bits_(0) {}
+  virtual ~BypassPredictor() {}
+
+  // Size the per set state, called from Cache::SetConfig
+  virtual void Reset(int set_num, int associativity, int block_size);
+
+  // A miss on tag, full if every line of the set is valid. True to bypass.
+  bool OnMiss(uint64_t set_idx, uint64_t tag, bool full, StorageStats &stats);
+
+  void OnHit(uint64_t set_idx, int line_idx) { lines_[Index(set_idx, line_idx)] |= kLineReused; }
+
+  // A missing block was placed in line_idx, full if it took a victim's place
+  void OnFill(uint64_t set_idx, int line_idx, bool full, StorageStats &stats) {
+    lines_[Index(set_idx, line_idx)] = full ? kLineKept : 0;
+    stats.keep_num += full;
+  }
+
+  // The valid line_idx holding tag is evicted from a full set
+  void OnEvict(uint64_t set_idx, int line_idx, uint64_t tag, StorageStats &stats);
+
+  // Hash of the per set state with the lines in canonical order, see ReplacementPolicy
+  uint64_t SetStateHash(uint64_t set_idx, const int *lines) const;
+
+  // Hash of the state shared by all sets
+  virtual uint64_t SharedStateHash() const { return 0; }
+
+ protected:
+  // Whether a miss on tag in a full set should bypass
+  virtual bool Predict(uint64_t set_idx, uint64_t tag) = 0;
+
+  // Learn from a block leaving the cache, reused if it was hit after its fill
+  virtual void Train(uint64_t /*set_idx*/, uint64_t /*tag*/, bool /*reused*/) {}
+
+  // Hash of the predictor's own per set state
+  virtual uint64_t PredictorSetHash(uint64_t /*set_idx*/) const { return 0; }
+
+  size_t Index(uint64_t set_idx, int line_idx) const { return set_idx * assoc_ + line_idx; }
+
+  // Block address without the offset bits
+  uint64_t Block(uint64_t set_idx, uint64_t tag) const { return tag * set_num_ + set_idx; }
+
+  int set_num_;
+  int assoc_;
+  int block_bits_;
+
+ private:
+  enum LineFlags {
+    kLineReused = 1, // Hit since the fill
+    kLineKept = 2, // Filled by a decision not to bypass
+  };
+
+  vector<uint8_t> lines_; // LineFlags per line
+  TagRing bypassed_; // Last assoc bypassed tags per set
+};
+
+// The original heuristic: each set remembers the tags of its last mct
+// victims, and a miss on none of them counts as a capacity miss, which is
+// bypassed once the MCT is full. Misses on recent victims are conflict
+// misses and fill as usual.
+class MctPredictor final : public BypassPredictor {
+ public:
+  explicit MctPredictor(int size) : size_(size) {}
+
+  void Reset(int set_num, int associativity, int block_size);
+
+ protected:
+  bool Predict(uint64_t set_idx, uint64_t tag) {
+    return size_ > 0 && victims_.Full(set_idx) && !victims_.Contains(set_idx, tag);
+  }
+  void Train(uint64_t set_idx, uint64_t tag, bool /*reused*/) {
+    if (size_ > 0)
+      victims_.Push(set_idx, tag);
+  }
+  uint64_t PredictorSetHash(uint64_t set_idx) const { return size_ > 0 ? victims_.Hash(set_idx) : 0; }
+
+ private:
+  int size_;
+  TagRing victims_;
+};
+
+// Counter predictor shared by the dead-block and signature predictors: a
+// table of saturating counters from 0 to max indexed by a hash of a key of
+// the block. Every BYPASS_LEARN_PERIOD predicted bypass fills anyway so that
+// blocks turning live are noticed.
+class CounterPredictor : public BypassPredictor {
+ public:
+  void Reset(int set_num, int associativity, int block_size);
+  uint64_t SharedStateHash() const;
+
+ protected:
+  CounterPredictor(int initial, int max) : initial_(initial), max_(max), predicted_(0) {}
+
+  // Table key of a block
+  virtual uint64_t Key(uint64_t set_idx, uint64_t tag) const = 0;
+
+  // Whether a counter predicts a bypass
+  virtual bool Dead(int counter) const = 0;
+
+  bool Predict(uint64_t set_idx, uint64_t tag);
+
+  uint8_t &Counter(uint64_t set_idx, uint64_t tag) {
+    return counters_[(Key(set_idx, tag) * 0x9e3779b97f4a7c15ULL) >> 32 & (BYPASS_TABLE_SIZE - 1)];
+  }
+
+  int initial_;
+  int max_;
+  vector<uint8_t> counters_;
+  uint32_t predicted_; // Bypass predictions so far, for the learning fills
+};
+
+// Dead-block predictor keyed by the block address: a block evicted without
+// reuse counts up towards bypassing its next fills, one reused resets it
+class DeadBlockPredictor final : public CounterPredictor {
+ public:
+  DeadBlockPredictor() : CounterPredictor(0, 3) {}
+
+ protected:
+  uint64_t Key(uint64_t set_idx, uint64_t tag) const { return Block(set_idx, tag); }
+  bool Dead(int counter) const { return counter == max_; }
+  void Train(uint64_t set_idx, uint64_t tag, bool reused) {
+    auto &counter = Counter(set_idx, tag);
+    counter = reused ? 0 : min(counter + 1, max_);
+  }
+};
+
+// Signature based insertion after SHiP, with the memory region of a block
+// as its signature since traces carry no PCs. Reuse counts a region up and
+// dead evictions count it down, and the blocks of a region at zero, which
+// SHiP would insert at distant re-reference, are bypassed instead.
+class SignaturePredictor final : public CounterPredictor {
+ public:
+  SignaturePredictor() : CounterPredictor(1, 7) {}
+
+ protected:
+  uint64_t Key(uint64_t set_idx, uint64_t tag) const {
+    return Block(set_idx, tag) >> max(BYPASS_REGION_BITS - block_bits_, 0);
+  }
+  bool Dead(int counter) const { return counter == 0; }
+  void Train(uint64_t set_idx, uint64_t tag, bool reused) {
+    auto &counter = Counter(set_idx, tag);
+    counter = reused ? min(counter + 1, max_) : max(counter - 1, 0);
+  }
+};
+
+// Bypass every miss of a full set but one in BYPASS_LEARN_PERIOD at random
+// with a fixed seed, like bimodal insertion, so that a streaming trace
+// leaves most of the cache to the blocks that were already there
+class ProbabilisticPredictor final : public BypassPredictor {
+ public:
+  ProbabilisticPredictor() : state_(0) {}
+
+  void Reset(int set_num, int associativity, int block_size);
+  uint64_t SharedStateHash() const { return state_; }
+
+ protected:
+  bool Predict(uint64_t /*set_idx*/, uint64_t /*tag*/) {
+    state_ ^= state_ << 13;
+    state_ ^= state_ >> 7;
+    state_ ^= state_ << 17;
+    return state_ % BYPASS_LEARN_PERIOD != 0;
+  }
+
+ private:
+  uint64_t state_; // xorshift64
+};
+
+// Predictor by name, mct_size for "mct". Returns nullptr for an unknown name.
+BypassPredictor *create_bypass_predictor(const string &name, int mct_size);
+
+// Comma separated list of the names accepted above
+const char *bypass_predictor_names();
+
+#endif //CACHE_BYPASS_H_
@@ -1,11 +1,10 @@
 #include <cstdlib>
 #include <cassert>
 #include <math.h>
+#include <algorithm>
 #include <iostream>
 #include "cache.hpp"
 
-extern bool verbose;
-
 bool is_power_of_two(uint64_t x) {
   return x && !(x & (x - 1));
 }
@@ -14,6 +13,48 @@ uint64_t get_bits(uint64_t x, unsigned int lo, unsigned int hi) {
   return x << (63 - hi) >> (63 - hi + lo);
 }
 
+// Compile-time part of a cache config, 0/-1/ReplacementPolicy defer to config_
+template <int Assoc, int BlockSize, class ReplacementPolicyType, int WriteThrough, int WriteAllocate>
+struct CacheShape {
+  typedef ReplacementPolicyType Policy;
+  static constexpr int kAssoc = Assoc;
+  static constexpr int kBlockSize = BlockSize;
+  static constexpr int kWriteThrough = WriteThrough;
+  static constexpr int kWriteAllocate = WriteAllocate;
+  static constexpr bool kTraced = false;
+};
+
+// Shape with the Event() calls compiled in
+template <class Shape>
+struct TracedShape : Shape {
+  static constexpr bool kTraced = true;
+};
+
+typedef CacheShape<0, 0, ReplacementPolicy, -1, -1> GenericShape;
+
+// Cache whose access path is compiled for one Shape
+template <class Shape>
+class CacheEngine final : public Cache {
+public:
+  CacheEngine() {}
+  ~CacheEngine() {}
+
+  void HandleRequest(uint64_t addr, int bytes, int read,
+                     char *content, int &hit, int &time, bool prefetch = false) {
+    if (tracer_)
+      Access<TracedShape<Shape>>(addr, bytes, read, content, hit, time, prefetch);
+    else
+      Access<Shape>(addr, bytes, read, content, hit, time, prefetch);
+  }
+
+  void HandleBatch(const AccessRequest *reqs, size_t n, char *content, AccessResult *results) {
+    if (tracer_)
+      Batch<TracedShape<Shape>>(reqs, n, content, results);
+    else
+      Batch<Shape>(reqs, n, content, results);
+  }
+};
+
 bool Cache::SetConfig(CacheConfig cc) {
   // Check if config is valid
   if (!is_power_of_two(cc.size)) return false;
@@ -22,84 +63,187 @@ bool Cache::SetConfig(CacheConfig cc) {
   if (cc.block_size * cc.associativity >= cc.size) return false;
   cc.set_num = cc.size / (cc.block_size * cc.associativity);
   if (!is_power_of_two(cc.set_num)) return false;
+  policy_.reset(create_replacement_policy(cc.replacement));
+  if (!policy_) return false;
+  bypass_.reset(cc.bypass ? create_bypass_predictor(cc.bypass_predictor, cc.mct) : nullptr);
+  if (cc.bypass && !bypass_) return false;
+  prefetcher_.reset(cc.prefetch > 0 ? create_prefetcher(cc.prefetcher) : nullptr);
+  if (cc.prefetch > 0 && !prefetcher_) return false;
+  if (cc.mshrs < 0) return false;
 
   config_ = cc;
 
   s = log2(config_.set_num);
   b = log2(config_.block_size);
   t = ADDR_LEN - s - b;
+  bit_words_ = (config_.associativity + 63) / 64;
 
-  sets = vector<CacheSet>(cc.set_num);
-  for (int i = 0; i < cc.set_num; i++) {
-    sets[i].lines = vector<CacheLine>(cc.associativity);
-    sets[i].plru = vector<int>(cc.associativity, 0);
-    for (int j = 0; j < cc.associativity; j++) {
-      CacheLine &line = sets[i].lines[j];
-      line.access_counter = 0;
-      line.valid = false;
-      line.dirty = false;
-      line.blocks = vector<char>(cc.block_size);
-    }
+  size_t lines = (size_t) cc.set_num * cc.associativity;
+  tags_.assign(lines, 0);
+  valid_.assign((size_t) cc.set_num * bit_words_, 0);
+  dirty_.assign((size_t) cc.set_num * bit_words_, 0);
+  prefetched_.assign((size_t) cc.set_num * bit_words_, 0);
+  blocks_.assign(cc.tag_only ? 0 : lines * cc.block_size, 0);
+  prefetch_buf_.assign(cc.tag_only ? 0 : cc.block_size, 0);
+  ready_.assign(cc.mshrs > 0 ? lines : 0, 0);
+  mshr_release_ = decltype(mshr_release_)();
+  tick_ = 0;
+  last_set_ = 0;
+  last_line_ = -1;
+  lower_timed_ = lower_charged_ = false;
+  policy_->Reset(cc.set_num, cc.associativity);
+  if (bypass_)
+    bypass_->Reset(cc.set_num, cc.associativity, cc.block_size);
+  if (prefetcher_) {
+    prefetcher_->Reset(cc.prefetch, cc.prefetch_throttle);
+    polluted_.Reset(cc.set_num, cc.associativity);
   }
+  lookup_ = way_lookup(best_lookup_kernel());
   return true;
 }
 
 void Cache::HandleRequest(uint64_t addr, int bytes, int read,
                           char *content, int &hit, int &time, bool prefetch) {
-  assert(bytes > 0 && bytes <= config_.block_size);
-  if (verbose)
-    fprintf(stderr, "cache handle: addr = 0x%llx, size = %d\n", addr, bytes);
-  if (!prefetch) // reuse HandleRequest for prefetch in same cache level, shouldn't count as normal request
+  if (tracer_)
+    Access<TracedShape<GenericShape>>(addr, bytes, read, content, hit, time, prefetch);
+  else
+    Access<GenericShape>(addr, bytes, read, content, hit, time, prefetch);
+}
+
+void Cache::HandleBatch(const AccessRequest *reqs, size_t n, char *content, AccessResult *results) {
+  if (tracer_)
+    Batch<TracedShape<GenericShape>>(reqs, n, content, results);
+  else
+    Batch<GenericShape>(reqs, n, content, results);
+}
+
+template <class Shape>
+void Cache::Batch(const AccessRequest *reqs, size_t n, char *content, AccessResult *results) {
+  bool collapse = !WriteThrough<Shape>() && !Shape::kTraced && !config_.mshrs;
+  for (size_t i = 0; i < n;) {
+    Access<Shape>(reqs[i].addr, reqs[i].bytes, reqs[i].read, content, results[i].hit, results[i].time, false);
+    auto block = reqs[i].addr >> b;
+    size_t end = i + 1;
+    while (end < n && reqs[end].addr >> b == block)
+      end++;
+    if (end == i + 1 || !collapse || last_line_ < 0) {
+      i++;
+      continue;
+    }
+    int time = RepeatHits(reqs + i + 1, end - i - 1, content);
+    for (i++; i < end; i++)
+      results[i] = {1, time};
+  }
+}
+
+template <class Shape>
+void Cache::Access(uint64_t addr, int bytes, int read,
+                   char *content, int &hit, int &time, bool prefetch) {
+  const int block_size = BlockSize<Shape>();
+  assert(bytes > 0 && bytes <= block_size);
+  assert(Associativity<Shape>() == config_.associativity && block_size == config_.block_size);
+  if (!prefetch) { // reuse HandleRequest for prefetch in same cache level, shouldn't count as normal request
     stats_.access_counter++;
+    tick_++;
+  }
   hit = 0;
   time = 0;
+  lower_timed_ = !prefetch;
+  lower_charged_ = false;
   uint64_t set_idx, tag, block_offset;
   int line_idx;
   int lower_hit = 0, lower_time = 0;
+  bool full = false;
 
-  PartitionAlgorithm(addr, set_idx, tag, block_offset);
-  line_idx = GetLine(set_idx, tag);
+  PartitionAlgorithm<Shape>(addr, set_idx, tag, block_offset);
+  line_idx = GetLine<Shape>(set_idx, tag);
   // Bypass?
-  if (!BypassDecision(set_idx, line_idx, tag)) {
-    assert(block_offset + bytes <= config_.block_size);
+  if (!BypassDecision(set_idx, line_idx, tag, full)) {
+    assert(block_offset + bytes <= block_size);
     if (ReplaceDecision(line_idx, read)) {
       // Choose victim
-      line_idx = ReplaceAlgorithm(set_idx, time);
+      line_idx = ReplaceAlgorithm<Shape>(set_idx, time, prefetch);
     } else {
       // return hit & time
       if (read) { // read hit
-        ReadRequest(set_idx, line_idx, block_offset, bytes, content);
+        ReadRequest<Shape>(set_idx, line_idx, block_offset, bytes, content);
       } else { // write hit
-        WriteRequest(set_idx, line_idx, block_offset, tag, bytes, content, !config_.write_through);
-        if (config_.write_through) { // write through
+        WriteRequest<Shape>(set_idx, line_idx, block_offset, tag, bytes, content, !WriteThrough<Shape>());
+        if (WriteThrough<Shape>()) { // write through
+          lower_->SetCycle(cycle_ + latency_.bus_latency);
           lower_->HandleRequest(addr, bytes, read, content, lower_hit, lower_time);
         }
       }
+      Replacement<Shape>()->OnHit(set_idx, line_idx, tick_);
+      if (bypass_)
+        bypass_->OnHit(set_idx, line_idx);
       hit = 1;
       time += latency_.bus_latency + latency_.hit_latency + lower_time;
-      if (!prefetch)
+      if (!prefetch) {
         stats_.access_time += latency_.bus_latency + latency_.hit_latency;
+        last_set_ = set_idx;
+        last_line_ = line_idx;
+      }
+      // In timing mode a hit on a line still being filled merges into its MSHR and waits for the fill
+      if (config_.mshrs > 0 && ready_[LineIndex<Shape>(set_idx, line_idx)] > cycle_ + time) {
+        int wait = (int) (ready_[LineIndex<Shape>(set_idx, line_idx)] - cycle_) - time;
+        time += wait;
+        if (!prefetch) {
+          stats_.merge_num++;
+          stats_.access_time += wait;
+        }
+      }
+      Event<Shape>(prefetch ? kEventPrefetch : kEventAccess, addr, read, 1, time);
+      if (prefetcher_ && !prefetch && TestBit(prefetched_, set_idx, line_idx)) {
+        SetBit(prefetched_, set_idx, line_idx, false);
+        stats_.useful_prefetch_num++;
+        prefetcher_->OnFeedback(true);
+        PrefetchAlgorithm<Shape>(addr, false);
+        // A prefetch into this set may have evicted the line just hit
+        if (!TestBit(valid_, set_idx, line_idx) || tags_[LineIndex<Shape>(set_idx, line_idx)] != tag)
+          last_line_ = -1;
+      }
       return;
     }
   }
   // read/write miss
-  auto lower_addr = addr & ~((uint64_t) config_.block_size - 1);
+  if (line_idx == -1)
+    Event<Shape>(kEventBypass, addr, read, 0, 0);
+  auto lower_addr = addr & ~((uint64_t) block_size - 1);
   if (PrefetchDecision(prefetch)) {
-    PrefetchAlgorithm(lower_addr);
+    if (polluted_.Contains(set_idx, tag)) {
+      stats_.polluting_prefetch_num++;
+      polluted_.Erase(set_idx, tag);
+    }
+    PrefetchAlgorithm<Shape>(lower_addr, true);
   }
   // Fetch from lower layer
   hit = 0;
   if (!prefetch)
     stats_.miss_num++;
+  lower_timed_ = !prefetch;
+  lower_charged_ = !prefetch && line_idx != -1 && (read || WriteAllocate<Shape>());
+  uint64_t start = config_.mshrs > 0 ? AllocateMshr() : cycle_;
+  lower_->SetCycle(start + latency_.bus_latency);
   if (read) {
-    lower_->HandleRequest(lower_addr, config_.block_size, read, content, lower_hit, lower_time, prefetch);
+    lower_->HandleRequest(lower_addr, block_size, read, content, lower_hit, lower_time, prefetch);
   } else {
     lower_->HandleRequest(addr, bytes, read, content, lower_hit, lower_time, prefetch);
   }
   // Replacement
-  if (line_idx != -1 && (read || config_.write_allocate)) {
+  bool allocate = line_idx != -1 && (read || WriteAllocate<Shape>());
+  if (!prefetch) {
+    last_set_ = set_idx;
+    last_line_ = allocate ? line_idx : -1;
+  }
+  if (allocate) {
     stats_.fetch_num++;
-    WriteRequest(set_idx, line_idx, 0, tag, config_.block_size, content, false);
+    WriteRequest<Shape>(set_idx, line_idx, 0, tag, block_size, content, false);
+    Replacement<Shape>()->OnFill(set_idx, line_idx, tick_);
+    if (bypass_)
+      bypass_->OnFill(set_idx, line_idx, full, stats_);
+    if (prefetcher_)
+      SetBit(prefetched_, set_idx, line_idx, prefetch);
     time += latency_.bus_latency + latency_.hit_latency + lower_time;
     if (!prefetch)
       stats_.access_time += latency_.bus_latency + latency_.hit_latency + lower_time;
@@ -108,70 +252,137 @@ void Cache::HandleRequest(uint64_t addr, int bytes, int read,
     if (!prefetch)
       stats_.access_time += latency_.bus_latency;
   }
+  if (config_.mshrs > 0) {
+    // The MSHR is held until the fill completes, writebacks aside as they are buffered
+    uint64_t done = start + time;
+    mshr_release_.push(done);
+    if (allocate)
+      ready_[LineIndex<Shape>(set_idx, line_idx)] = done;
+    time = (int) (done - cycle_);
+    if (!prefetch) {
+      stats_.access_time += (int) (start - cycle_);
+      stats_.mshr_stall_time += (int) (start - cycle_);
+    }
+  }
+  Event<Shape>(prefetch ? kEventPrefetch : kEventAccess, addr, read, 0, time);
 }
 
+template <class Shape>
 void Cache::ReadRequest(uint64_t set_idx, uint64_t line_idx, uint64_t block_offset, int bytes, char *content) {
-  auto &line = sets[set_idx].lines[line_idx];
-  assert(line.valid);
-  for (uint64_t i = block_offset; i < block_offset + bytes; i++) {
-    content[i] = line.blocks[i];
+  auto idx = LineIndex<Shape>(set_idx, line_idx);
+  assert(TestBit(valid_, set_idx, line_idx));
+  if (!config_.tag_only) {
+    auto block = &blocks_[idx * BlockSize<Shape>()];
+    for (uint64_t i = block_offset; i < block_offset + bytes; i++) {
+      content[i] = block[i];
+    }
   }
-  line.access_counter = stats_.access_counter;
 }
 
+template <class Shape>
 void
 Cache::WriteRequest(uint64_t set_idx, uint64_t line_idx, uint64_t block_offset, uint64_t tag, int bytes, char *content,
                     bool dirty) {
-  if (verbose) {
-    fprintf(stderr, "cache write: set = %lld, line = %lld, offset = %lld, tag = %lld\n", set_idx, line_idx,
-            block_offset, tag);
-  }
-  auto &line = sets[set_idx].lines[line_idx];
-  for (uint64_t i = block_offset; i < block_offset + bytes; i++) {
-    line.blocks[i] = content[i];
+  auto idx = LineIndex<Shape>(set_idx, line_idx);
+  if (!config_.tag_only) {
+    auto block = &blocks_[idx * BlockSize<Shape>()];
+    for (uint64_t i = block_offset; i < block_offset + bytes; i++) {
+      block[i] = content[i];
+    }
   }
-  line.access_counter = stats_.access_counter;
-  line.tag = tag;
-  line.valid = true;
-  line.dirty = dirty;
+  tags_[idx] = tag;
+  SetBit(valid_, set_idx, line_idx, true);
+  SetBit(dirty_, set_idx, line_idx, dirty);
 }
 
-bool Cache::BypassDecision(int set_idx, int line_idx, uint64_t tag) {
-  if (line_idx != -1 || !config_.bypass || !config_.mct) // cache hit
+bool Cache::BypassDecision(int set_idx, int line_idx, uint64_t tag, bool &full) {
+  if (line_idx != -1 || !bypass_) // cache hit
     return false;
-  for (auto &line: sets[set_idx].lines) {
-    if (!line.valid)
-      return false; // compulsory miss
-  }
-  queue<uint64_t> mct = sets[set_idx].mct;
-  if (mct.size() < config_.mct) return false;
-  while (!mct.empty()) {
-    auto x = mct.front();
-    mct.pop();
-    assert(mct.size() != sets[set_idx].mct.size());
-    if (x == tag)
-      return false; // conflict miss
-  }
-  return true; // capacity miss
+  full = FreeLine(set_idx) == -1; // else a compulsory miss, never bypassed
+  return bypass_->OnMiss(set_idx, tag, full, stats_);
 }
 
+template <class Shape>
 void Cache::PartitionAlgorithm(uint64_t addr, uint64_t &set_idx, uint64_t &tag, uint64_t &block_offset) {
+  const int block_bits = Shape::kBlockSize ? __builtin_ctz(Shape::kBlockSize) : b;
 
-  block_offset = get_bits(addr, 0, b - 1);
-  set_idx = get_bits(addr, b, b + s - 1);
-  tag = get_bits(addr, b + s, ADDR_LEN - 1);
+  block_offset = addr & ((uint64_t) BlockSize<Shape>() - 1);
+  set_idx = (addr >> block_bits) & ((uint64_t) config_.set_num - 1);
+  tag = addr >> (block_bits + s);
 
 }
 
+template <class Shape>
 int Cache::GetLine(uint64_t set_idx, uint64_t tag) {
+  return lookup_(&tags_[LineIndex<Shape>(set_idx, 0)], &valid_[set_idx * bit_words_], Associativity<Shape>(), tag);
+}
 
-  auto &lines = sets[set_idx].lines;
+int Cache::RepeatHits(const AccessRequest *reqs, size_t n, char *content) {
+  assert(last_line_ >= 0 && !config_.write_through);
+  bool written = false;
+  auto tag = tags_[LineIndex<GenericShape>(last_set_, last_line_)];
+  for (size_t i = 0; i < n; i++) {
+    written |= !reqs[i].read;
+    if (config_.tag_only)
+      continue;
+    uint64_t block_offset = reqs[i].addr & (config_.block_size - 1);
+    if (reqs[i].read)
+      ReadRequest<GenericShape>(last_set_, last_line_, block_offset, reqs[i].bytes, content);
+    else
+      WriteRequest<GenericShape>(last_set_, last_line_, block_offset, tag, reqs[i].bytes, content, true);
+  }
+  if (written)
+    SetBit(dirty_, last_set_, last_line_, true);
+  stats_.access_counter += (int) n;
+  tick_ += n;
+  policy_->OnHits(last_set_, last_line_, tick_, n);
+  if (bypass_)
+    bypass_->OnHit(last_set_, last_line_);
+  int time = latency_.bus_latency + latency_.hit_latency;
+  stats_.access_time += time * (int) n;
+  return time;
+}
 
-  for (int i = 0; i < config_.associativity; i++) {
-    if (lines[i].valid && lines[i].tag == tag)
-      return i;
+uint64_t Cache::StateHash(bool unique_now) const {
+  uint64_t hash = state_hash_step(policy_->SharedStateHash(), bypass_ ? bypass_->SharedStateHash() : 0);
+  vector<int> lines(config_.associativity);
+  for (uint64_t set = 0; set < (uint64_t) config_.set_num; set++) {
+    policy_->CanonicalOrder(set, unique_now, lines.data());
+    for (int line: lines) {
+      uint64_t line_state = 0;
+      if (TestBit(valid_, set, line))
+        line_state = tags_[set * config_.associativity + line] << 2 | TestBit(dirty_, set, line) << 1 | 1;
+      hash = state_hash_step(hash, line_state);
+      if (prefetcher_)
+        hash = state_hash_step(hash, TestBit(prefetched_, set, line));
+    }
+    hash = state_hash_step(hash, policy_->SetStateHash(set, lines.data()));
+    if (bypass_)
+      hash = state_hash_step(hash, bypass_->SetStateHash(set, lines.data()));
+    if (prefetcher_)
+      hash = state_hash_step(hash, polluted_.Hash(set));
   }
+  return prefetcher_ ? state_hash_step(hash, prefetcher_->StateHash()) : hash;
+}
+
+uint64_t Cache::AllocateMshr() {
+  while (!mshr_release_.empty() && mshr_release_.top() <= cycle_)
+    mshr_release_.pop();
+  if ((int) mshr_release_.size() < config_.mshrs)
+    return cycle_;
+  uint64_t start = mshr_release_.top();
+  mshr_release_.pop();
+  return start;
+}
 
+int Cache::FreeLine(uint64_t set_idx) const {
+  auto valid = &valid_[set_idx * bit_words_];
+  for (int w = 0; w < bit_words_; w++) {
+    int ways = min(64, config_.associativity - 64 * w);
+    uint64_t free = ~valid[w] & (ways == 64 ? ~0ULL : (1ULL << ways) - 1);
+    if (free)
+      return 64 * w + __builtin_ctzll(free);
+  }
   return -1;
 }
 
@@ -179,73 +390,119 @@ bool Cache::ReplaceDecision(int line_idx, int read) {
   return line_idx == -1;
 }
 
-int Cache::ReplaceAlgorithm(uint64_t set_idx, int &time) {
-  int line_idx = -1;
-  char *buf = static_cast<char *>(malloc(sizeof(char) * config_.block_size));
-  auto &lines = sets[set_idx].lines;
+template <class Shape>
+int Cache::ReplaceAlgorithm(uint64_t set_idx, int &time, bool prefetch) {
   // find free cache line
-  for (int i = 0; i < lines.size(); i++) {
-    if (!lines[i].valid) {
-      line_idx = i;
-      break;
-    }
-  }
+  int line_idx = FreeLine(set_idx);
 
   // no free cache line
   if (line_idx == -1) {
-    if (config_.replacement == "lru") {
-      line_idx = 0;
-      for (int i = 1; i < lines.size(); i++) {
-        if (lines[i].access_counter < lines[line_idx].access_counter)
-          line_idx = i;
-      }
-    } else if (config_.replacement == "plru") {
-      line_idx = 0;
-      int j = 0;
-      for (int i = 0; i < log2(sets[set_idx].lines.size()); i++) {
-        int tmp = sets[set_idx].plru[j];
-        line_idx = (line_idx << 1) | sets[set_idx].plru[j];
-        sets[set_idx].plru[j] ^= 1;
-        j = j * 2 + 1 + tmp;
-      }
-    }
-    // insert to MCT
-    if (config_.mct > 0) {
-      if (sets[set_idx].mct.size() == config_.mct)
-        sets[set_idx].mct.pop();
-      sets[set_idx].mct.push(lines[line_idx].tag);
-    }
+    line_idx = Replacement<Shape>()->Victim(set_idx);
+    if (bypass_)
+      bypass_->OnEvict(set_idx, line_idx, tags_[LineIndex<Shape>(set_idx, line_idx)], stats_);
+    // Upper level prefetches arrive flagged too, only our own are tracked
+    if (prefetch && prefetcher_)
+      polluted_.Push(set_idx, tags_[LineIndex<Shape>(set_idx, line_idx)]);
   }
 
-  auto &line = lines[line_idx];
+  auto idx = LineIndex<Shape>(set_idx, line_idx);
   stats_.replace_num++;
 
-  // Write back to lower layer
-  if (line.valid && line.dirty) {
-    uint64_t addr = (line.tag << (s + b)) | (set_idx << b);
-    for (int i = 0; i < config_.block_size; i++)
-      buf[i] = line.blocks[i];
+  bool dirty = TestBit(dirty_, set_idx, line_idx);
+  if (prefetcher_ && TestBit(valid_, set_idx, line_idx) && TestBit(prefetched_, set_idx, line_idx)) {
+    SetBit(prefetched_, set_idx, line_idx, false);
+    stats_.useless_prefetch_num++;
+    prefetcher_->OnFeedback(false);
+  }
+  if (TestBit(valid_, set_idx, line_idx))
+    Event<Shape>(kEventEviction, (tags_[idx] << (s + b)) | (set_idx << b), 0, dirty, 0);
+
+  // Write back to lower layer, a write never modifies content so the line is passed as is
+  if (TestBit(valid_, set_idx, line_idx) && dirty) {
+    uint64_t addr = (tags_[idx] << (s + b)) | (set_idx << b);
     int lower_hit, lower_time;
-    lower_->HandleRequest(addr, config_.block_size, 0, buf, lower_hit, lower_time);
-    time += lower_time;
+    auto block = config_.tag_only ? nullptr : &blocks_[idx * BlockSize<Shape>()];
+    lower_->SetCycle(cycle_ + latency_.bus_latency);
+    lower_->HandleRequest(addr, BlockSize<Shape>(), 0, block, lower_hit, lower_time);
+    if (!config_.mshrs) // A write buffer hides them in timing mode
+      time += lower_time;
+    Event<Shape>(kEventWriteback, addr, 0, 1, lower_time);
   }
 
-  free(buf);
   return line_idx;
 }
 
 bool Cache::PrefetchDecision(bool prefetch) {
-  return config_.prefetch > 0 && !prefetch;
+  return prefetcher_ && !prefetch;
 }
 
-void Cache::PrefetchAlgorithm(uint64_t from_addr) {
-  char *buf = static_cast<char *>(malloc(sizeof(char) * config_.block_size));
+template <class Shape>
+void Cache::PrefetchAlgorithm(uint64_t addr, bool miss) {
   int lower_hit, lower_time;
-  for (uint64_t i = 1; i <= config_.prefetch; i++) {
+  prefetch_blocks_.clear();
+  prefetcher_->Trigger(addr / BlockSize<Shape>(), miss, prefetch_blocks_);
+  // Prefetches never trigger the prefetcher, so the picks stay put meanwhile
+  for (auto block: prefetch_blocks_) {
     stats_.prefetch_num++;
-    auto addr = from_addr + i * config_.block_size;
-    HandleRequest(addr, config_.block_size, 1, buf, lower_hit, lower_time, true);
+    Access<Shape>(block * BlockSize<Shape>(), BlockSize<Shape>(), 1, config_.tag_only ? nullptr : prefetch_buf_.data(),
+                  lower_hit, lower_time, true);
+  }
+}
+
+// Pre-instantiated engines: write-back write-allocate caches with 64B blocks
+#define CACHE_ENGINE(assoc, name, policy)                                                \
+  if (!cache && cc.associativity == assoc && cc.block_size == 64 && cc.replacement == name && \
+      !cc.write_through && cc.write_allocate)                                           \
+    cache = new CacheEngine<CacheShape<assoc, 64, policy, 0, 1>>();
+
+Cache *create_cache(const CacheConfig &cc) {
+  Cache *cache = nullptr;
+  CACHE_ENGINE(2, "lru", LruPolicy)
+  CACHE_ENGINE(4, "lru", LruPolicy)
+  CACHE_ENGINE(8, "lru", LruPolicy)
+  CACHE_ENGINE(16, "lru", LruPolicy)
+  CACHE_ENGINE(2, "plru", PlruPolicy)
+  CACHE_ENGINE(4, "plru", PlruPolicy)
+  CACHE_ENGINE(8, "plru", PlruPolicy)
+  CACHE_ENGINE(16, "plru", PlruPolicy)
+  CACHE_ENGINE(8, "srrip", RripPolicy)
+  CACHE_ENGINE(16, "srrip", RripPolicy)
+  CACHE_ENGINE(8, "drrip", RripPolicy)
+  CACHE_ENGINE(16, "drrip", RripPolicy)
+  if (!cache)
+    cache = new Cache();
+  if (!cache->SetConfig(cc)) {
+    delete cache;
+    return nullptr;
   }
-  free(buf);
+  return cache;
 }
 
+bool set_bypass_predictor(CacheConfig &cc, const string &name) {
+  if (name == "none") {
+    cc.bypass = false;
+    return true;
+  }
+  unique_ptr<BypassPredictor> predictor(create_bypass_predictor(name, 1));
+  if (!predictor)
+    return false;
+  cc.bypass = true;
+  cc.bypass_predictor = name;
+  if (name == "mct" && cc.mct <= 0)
+    cc.mct = 1;
+  return true;
+}
+
+bool set_prefetcher(CacheConfig &cc, const string &name) {
+  if (name == "none") {
+    cc.prefetch = 0;
+    return true;
+  }
+  unique_ptr<Prefetcher> prefetcher(create_prefetcher(name));
+  if (!prefetcher)
+    return false;
+  cc.prefetcher = name;
+  if (cc.prefetch <= 0)
+    cc.prefetch = 3;
+  return true;
+}
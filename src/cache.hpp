@@ -3,9 +3,18 @@
 
 #include <stdint.h>
 #include "storage.hpp"
+#include "aligned_allocator.hpp"
+#include "way_lookup.hpp"
+#include "replacement.hpp"
+#include "state_hash.hpp"
+#include "bypass.hpp"
+#include "prefetch.hpp"
+#include "tag_ring.hpp"
+#include "event_trace.hpp"
+#include <memory>
+#include <queue>
 #include <vector>
 #include <string>
-#include <queue>
 
 using namespace std;
 
@@ -19,30 +28,21 @@ typedef struct CacheConfig_ {
   bool write_through; // 0|1 for back|through
   bool write_allocate; // 0|1 for no-alc|alc
   bool bypass;
-  int prefetch; // number of blocks to prefetch
+  int prefetch; // number of blocks to prefetch, the degree of the prefetcher
   int mct; // size of set mct
-  string replacement;
+  string replacement; // Name accepted by create_replacement_policy()
+  bool tag_only; // Track tags only, content is never read or written
+  string bypass_predictor; // Name accepted by create_bypass_predictor(), used if bypass
+  string prefetcher; // Name accepted by create_prefetcher(), used if prefetch > 0
+  bool prefetch_throttle; // Adapt the prefetch degree to the accuracy, see Prefetcher
+  int mshrs; // Misses in flight at once in the non-blocking timing model, 0 for the serial model
 } CacheConfig;
 
-typedef struct CacheLine_ {
-  int access_counter;
-  bool valid;
-  bool dirty;
-  uint64_t tag;
-  vector<char> blocks;
-} CacheLine;
-
-typedef struct CacheSet_ {
-  vector<CacheLine> lines;
-  vector<int> plru;
-  queue<uint64_t> mct;
-} CacheSet;
-
 class Cache : public Storage {
 public:
-  Cache() { }
+  Cache() : tracer_(nullptr), level_(0) { }
 
-  ~Cache() {}
+  virtual ~Cache() {}
 
   // Sets & Gets
   bool SetConfig(CacheConfig cc);
@@ -51,40 +51,179 @@ public:
 
   void SetLower(Storage *ll) { lower_ = ll; }
 
+  // Emit the events of this cache as level to tracer, nullptr to stop. The
+  // traced access path is a separate instantiation, so the untraced one
+  // carries no tracing code at all.
+  void SetTracer(EventTracer *tracer, int level) {
+    tracer_ = tracer;
+    level_ = level;
+  }
+
+  // How the time of the lower request being issued counts, for lower levels
+  // that answer later (PipelineLink): timed if it adds to the time returned
+  // to the caller, charged if it also adds to this cache's access_time
+  bool LowerTimed() const { return lower_timed_; }
+  bool LowerCharged() const { return lower_charged_; }
+
   // Main access process
   void HandleRequest(uint64_t addr, int bytes, int read,
                      char *content, int &hit, int &time, bool prefetch = false);
 
+  // A request to the block of the one before it is sure to hit once that
+  // left the block resident, so such runs are accounted in bulk after their
+  // first request. Not for write-through caches, whose write hits go lower,
+  // while tracing, which records every access, or in timing mode.
+  void HandleBatch(const AccessRequest *reqs, size_t n, char *content, AccessResult *results);
+
+  // Hash of the tags, valid/dirty/prefetched bits, replacement, bypass and
+  // prefetcher state, which with the config decide every later access.
+  // Lines are hashed in the policy's canonical order, so states that only
+  // differ in which line holds a block hash alike. Payloads are left out.
+  // [in] unique_now: no prefetches reach this cache, see ReplacementPolicy::CanonicalOrder()
+  uint64_t StateHash(bool unique_now) const;
+
+
+protected:
+  // Access path shared by the runtime configured Cache and the specialized
+  // CacheEngine instantiations in cache.cpp, Shape fixes the parts of the
+  // config known at compile time
+  template <class Shape>
+  void Access(uint64_t addr, int bytes, int read, char *content, int &hit, int &time, bool prefetch);
+
+  // HandleBatch() over Access<Shape>
+  template <class Shape>
+  void Batch(const AccessRequest *reqs, size_t n, char *content, AccessResult *results);
+
+  template <class Shape> int Associativity() const {
+    return Shape::kAssoc ? Shape::kAssoc : config_.associativity;
+  }
+  template <class Shape> int BlockSize() const {
+    return Shape::kBlockSize ? Shape::kBlockSize : config_.block_size;
+  }
+  // Shape::Policy is the concrete final policy or ReplacementPolicy itself
+  template <class Shape> typename Shape::Policy *Replacement() const {
+    return static_cast<typename Shape::Policy *>(policy_.get());
+  }
+  template <class Shape> bool WriteThrough() const {
+    return Shape::kWriteThrough >= 0 ? Shape::kWriteThrough != 0 : config_.write_through;
+  }
+  template <class Shape> bool WriteAllocate() const {
+    return Shape::kWriteAllocate >= 0 ? Shape::kWriteAllocate != 0 : config_.write_allocate;
+  }
+  // Compiled out unless Shape is a TracedShape
+  template <class Shape> void Event(EventType type, uint64_t addr, int read, int flag, int time) {
+    if (Shape::kTraced)
+      tracer_->Emit({addr, time, (uint8_t) type, (uint8_t) level_, (uint8_t) read, (uint8_t) flag});
+  }
+
+  CacheConfig config_;
+  EventTracer *tracer_;
+  int level_;
 
 private:
-  // Bypassing
-  bool BypassDecision(int set_idx, int line_idx, uint64_t tag);
+  // Bypassing, full tells whether the set had no free line
+  bool BypassDecision(int set_idx, int line_idx, uint64_t tag, bool &full);
 
   // Partitioning
+  template <class Shape>
   void PartitionAlgorithm(uint64_t addr, uint64_t &set_idx, uint64_t &tag, uint64_t &block_offset);
 
+  template <class Shape>
   int GetLine(uint64_t set_idx, uint64_t tag);
 
+  template <class Shape>
   void ReadRequest(uint64_t set_idx, uint64_t line_idx, uint64_t block_offset, int bytes, char *content);
 
+  template <class Shape>
   void WriteRequest(uint64_t set_idx, uint64_t line_idx, uint64_t block_offset, uint64_t tag, int bytes, char *content, bool dirty);
 
   // Replacement
   bool ReplaceDecision(int line_idx, int read);
 
-  int ReplaceAlgorithm(uint64_t set_idx, int &time);
+  // [in] prefetch: the line is taken for a prefetch
+  template <class Shape>
+  int ReplaceAlgorithm(uint64_t set_idx, int &time, bool prefetch);
 
   // Prefetching
   bool PrefetchDecision(bool prefetch);
 
-  void PrefetchAlgorithm(uint64_t next_addr);
+  // Issue what the prefetcher picks for a demand miss on addr's block, or a
+  // demand hit on a prefetched line if miss is false
+  template <class Shape>
+  void PrefetchAlgorithm(uint64_t addr, bool miss);
+
+  // Tag store accessors, the lines of a set are contiguous
+  template <class Shape>
+  size_t LineIndex(uint64_t set_idx, int line_idx) const {
+    return set_idx * Associativity<Shape>() + line_idx;
+  }
+
+  bool TestBit(const AlignedVector<uint64_t> &bits, uint64_t set_idx, int line_idx) const {
+    return bits[set_idx * bit_words_ + (line_idx >> 6)] >> (line_idx & 63) & 1;
+  }
+
+  void SetBit(AlignedVector<uint64_t> &bits, uint64_t set_idx, int line_idx, bool value) {
+    auto &word = bits[set_idx * bit_words_ + (line_idx >> 6)];
+    word = (word & ~(1ULL << (line_idx & 63))) | ((uint64_t) value << (line_idx & 63));
+  }
+
+  // First invalid line of the set, -1 if all lines are valid
+  int FreeLine(uint64_t set_idx) const;
+
+  // Cycle from which a miss arriving at cycle_ holds an MSHR, the earliest
+  // release if all config_.mshrs are taken. The caller pushes its release.
+  uint64_t AllocateMshr();
+
+  // Hits on the block of the last demand access for each of reqs, which
+  // must be resident, accounted in bulk exactly as one Access per request
+  // would on a write-back cache. Returns the time of each hit.
+  int RepeatHits(const AccessRequest *reqs, size_t n, char *content);
 
   int t, s, b; // Number of tag/set/block bits
+  int bit_words_; // Words per set in the bit arrays
+
+  // Flat tag store indexed by LineIndex(), so a set lookup touches one or
+  // two host cache lines instead of chasing per line vectors
+  AlignedVector<uint64_t> tags_;
+  AlignedVector<uint64_t> valid_; // Bit arrays of bit_words_ words per set
+  AlignedVector<uint64_t> dirty_;
+  AlignedVector<uint64_t> prefetched_; // Filled by a prefetch and not hit by demand since
+  vector<char> blocks_; // block_size bytes of payload per line, empty if tag_only
+  uint64_t tick_; // 64-bit stats_.access_counter, passed to the policy as now
+  uint64_t last_set_; // Where the last demand access left its block
+  int last_line_; // -1 if it wasn't allocated
+  unique_ptr<ReplacementPolicy> policy_;
+  unique_ptr<BypassPredictor> bypass_; // nullptr unless config_.bypass
+  unique_ptr<Prefetcher> prefetcher_; // nullptr unless config_.prefetch > 0
+  vector<uint64_t> prefetch_blocks_; // The prefetcher's picks for one trigger
+  TagRing polluted_; // Per set, the last assoc tags evicted to make room for a prefetch
+  vector<char> prefetch_buf_; // Empty if tag_only
+  // Timing mode state, see CacheConfig::mshrs. Requests are timed in the
+  // order they arrive rather than by cycle, so an MSHR released after an
+  // arrival may already be taken by an earlier arriving miss.
+  vector<uint64_t> ready_; // Per line, the cycle its fill completes
+  priority_queue<uint64_t, vector<uint64_t>, greater<uint64_t>> mshr_release_; // Of the misses in flight
+  WayLookup lookup_; // GetLine kernel picked from CPUID
+  bool lower_timed_;
+  bool lower_charged_;
 
-  vector<CacheSet> sets;
-  CacheConfig config_;
   Storage *lower_;
   DISALLOW_COPY_AND_ASSIGN(Cache);
 };
 
+// Build a configured cache, using a pre-instantiated engine specialized for
+// the associativity, block size, replacement and write policy when one
+// exists and the generic Cache otherwise. Returns nullptr for an invalid config.
+Cache *create_cache(const CacheConfig &cc);
+
+// Turn bypassing off for none, or on with the named predictor, giving the
+// mct predictor the --optimized MCT size if it had none. False for an
+// unknown name, leaving cc unchanged.
+bool set_bypass_predictor(CacheConfig &cc, const string &name);
+
+// Turn prefetching off for none, or on with the named prefetcher, giving it
+// the --optimized degree of 3 if the level had none. False for an unknown
+// name, leaving cc unchanged.
+bool set_prefetcher(CacheConfig &cc, const string &name);
+
 #endif //CACHE_CACHE_H_ 
@@ -24,5 +24,15 @@
 #define MEM_BUS_LATENCY 0
 #define MEM_HIT_LATENCY 100
 
+// DRAM back end, timings in cycles
+#define DRAM_CHANNELS 1
+#define DRAM_RANKS 1
+#define DRAM_BANKS 8
+#define DRAM_ROW_SIZE 8192
+#define DRAM_T_RCD 40
+#define DRAM_T_CAS 40
+#define DRAM_T_RP 40
+#define DRAM_T_BURST 8
+
 
 #endif //CACHE_SIMULATOR_CONFIG_H
@@ -0,0 +1,122 @@
+#include <algorithm>
+#include "dram.hpp"
+#include "state_hash.hpp"
+
+static bool is_pow2(int x) {
+  return x > 0 && !(x & (x - 1));
+}
+
+// Take the low bits of x
+static uint64_t take_bits(uint64_t &x, int bits) {
+  uint64_t value = x & ((1ULL << bits) - 1);
+  x >>= bits;
+  return value;
+}
+
+bool Dram::SetConfig(const DramConfig &dc) {
+  if (!is_pow2(dc.channels) || !is_pow2(dc.ranks) || !is_pow2(dc.banks)) return false;
+  if (!is_pow2(dc.row_size) || dc.row_size < DRAM_BURST_SIZE) return false;
+  if (dc.t_rcd < 0 || dc.t_cas < 0 || dc.t_rp < 0 || dc.t_burst <= 0) return false;
+  if (dc.mapping == "page")
+    mapping_ = kMappingPage;
+  else if (dc.mapping == "block")
+    mapping_ = kMappingBlock;
+  else if (dc.mapping == "xor")
+    mapping_ = kMappingXor;
+  else
+    return false;
+
+  config_ = dc;
+  channel_bits_ = __builtin_ctz(dc.channels);
+  rank_bits_ = __builtin_ctz(dc.ranks);
+  bank_bits_ = __builtin_ctz(dc.banks);
+  column_bits_ = __builtin_ctz(dc.row_size / DRAM_BURST_SIZE);
+  banks_.assign((size_t) dc.channels * dc.ranks * dc.banks, {kNoRow, 0});
+  bus_free_.assign(dc.channels, 0);
+  return true;
+}
+
+void Dram::Map(uint64_t addr, int &channel, int &bank, uint64_t &row) const {
+  uint64_t x = addr / DRAM_BURST_SIZE;
+  uint64_t rank, bank_idx;
+  channel = (int) take_bits(x, channel_bits_);
+  if (mapping_ == kMappingBlock) {
+    bank_idx = take_bits(x, bank_bits_);
+    rank = take_bits(x, rank_bits_);
+    take_bits(x, column_bits_);
+  } else {
+    take_bits(x, column_bits_);
+    bank_idx = take_bits(x, bank_bits_);
+    rank = take_bits(x, rank_bits_);
+  }
+  row = x;
+  if (mapping_ == kMappingXor)
+    bank_idx ^= row & ((1ULL << bank_bits_) - 1);
+  bank = (int) ((((uint64_t) channel << rank_bits_ | rank) << bank_bits_) | bank_idx);
+}
+
+uint64_t Dram::Burst(uint64_t addr, uint64_t arrival) {
+  int channel, bank_idx;
+  uint64_t row;
+  Map(addr, channel, bank_idx, row);
+  auto &bank = banks_[bank_idx];
+  uint64_t column = max(arrival, bank.ready);
+  if (bank.row == row) {
+    stats_.row_hit_num++;
+  } else if (bank.row == kNoRow) {
+    column += config_.t_rcd;
+  } else {
+    stats_.row_conflict_num++;
+    column += config_.t_rp + config_.t_rcd;
+  }
+  uint64_t data = max(column + config_.t_cas, bus_free_[channel]);
+  bus_free_[channel] = data + config_.t_burst;
+  uint64_t done = data + config_.t_burst;
+  // The next column command may follow one burst later, a precharge once the data is out
+  bank.row = config_.open_page ? row : kNoRow;
+  bank.ready = config_.open_page ? column + config_.t_burst : done + config_.t_rp;
+  return done;
+}
+
+void Dram::HandleRequest(uint64_t addr, int bytes, int /*read*/,
+                         char * /*content*/, int &hit, int &time, bool /*prefetch*/) {
+  uint64_t arrival = config_.timed ? cycle_ : 0;
+  uint64_t first = addr / DRAM_BURST_SIZE, last = (addr + max(bytes, 1) - 1) / DRAM_BURST_SIZE;
+  uint64_t done = arrival;
+  for (auto burst = first; burst <= last; burst++)
+    done = max(done, Burst(burst * DRAM_BURST_SIZE, arrival));
+  if (!config_.timed) {
+    // Only the open rows carry over
+    for (auto burst = first; burst <= last; burst++) {
+      int channel, bank_idx;
+      uint64_t row;
+      Map(burst * DRAM_BURST_SIZE, channel, bank_idx, row);
+      banks_[bank_idx].ready = bus_free_[channel] = 0;
+    }
+  }
+  hit = 1;
+  time = (int) (done - arrival) + latency_.bus_latency;
+  stats_.access_time += time;
+  stats_.access_counter++;
+  stats_.byte_num += (int) (last - first + 1) * DRAM_BURST_SIZE;
+}
+
+uint64_t Dram::StateHash() const {
+  uint64_t hash = 0;
+  for (auto &bank: banks_)
+    hash = state_hash_step(hash, bank.row);
+  return hash;
+}
+
+Dram *create_dram(const DramConfig &dc) {
+  auto dram = new Dram();
+  if (!dram->SetConfig(dc)) {
+    delete dram;
+    return nullptr;
+  }
+  return dram;
+}
+
+const char *dram_mapping_names() {
+  return "page, block, xor";
+}
@@ -0,0 +1,87 @@
+#ifndef CACHE_DRAM_H_
+#define CACHE_DRAM_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "memory.hpp"
+
+using namespace std;
+
+#define DRAM_BURST_SIZE 64 // Bytes per burst, the unit the address mappings interleave
+
+typedef struct DramConfig_ {
+  int channels;
+  int ranks; // Per channel
+  int banks; // Per rank
+  int row_size; // Bytes per row of a bank
+  int t_rcd; // Activate to column command
+  int t_cas; // Column command to data
+  int t_rp; // Precharge
+  int t_burst; // Data bus cycles per burst
+  bool open_page; // Rows stay open after an access, else they are precharged right away
+  string mapping; // Name accepted by dram_mapping_names()
+  bool timed; // Requests carry arrival cycles, see Storage::SetCycle(), so they queue on busy banks and buses
+} DramConfig;
+
+// DRAM back end. An access to the open row of its bank takes tCAS, to a
+// bank without an open row tRCD + tCAS and to another row tRP + tRCD +
+// tCAS, then the burst plus the bus latency. Closed page precharges after
+// each access, off the critical path. Untimed, only the row buffer state
+// carries from one request to the next; timed, a request also waits for its
+// bank and its channel's data bus to be free. The bursts of one request
+// always queue on each other. hit_latency is not used.
+class Dram final : public Memory {
+ public:
+  Dram() {}
+  ~Dram() {}
+
+  // False if the config is invalid
+  bool SetConfig(const DramConfig &dc);
+
+  // One burst per DRAM_BURST_SIZE bytes touched, done once the last is out
+  void HandleRequest(uint64_t addr, int bytes, int read,
+                     char *content, int &hit, int &time, bool prefetch = false);
+
+  // Hash of the open rows
+  uint64_t StateHash() const;
+
+  // Bytes per cycle with every channel's data bus busy
+  double PeakBandwidth() const { return (double) config_.channels * DRAM_BURST_SIZE / config_.t_burst; }
+
+ private:
+  enum Mapping {
+    kMappingPage, // Row, rank, bank, column, channel from the top: a row's bursts stay in one bank
+    kMappingBlock, // Row, column, rank, bank, channel: consecutive bursts spread over the banks
+    kMappingXor, // Page with the row's low bits XORed into the bank, spreading row conflicts
+  };
+
+  typedef struct Bank_ {
+    uint64_t row; // kNoRow if precharged
+    uint64_t ready; // Cycle the bank takes its next burst, 0 between untimed requests
+  } Bank;
+
+  static constexpr uint64_t kNoRow = ~0ULL;
+
+  // Split addr into the channel, the bank index over all channels and ranks, and the row
+  void Map(uint64_t addr, int &channel, int &bank, uint64_t &row) const;
+
+  // Issue the burst at addr no earlier than arrival, returns the cycle its data is out
+  uint64_t Burst(uint64_t addr, uint64_t arrival);
+
+  DramConfig config_;
+  Mapping mapping_;
+  int channel_bits_, rank_bits_, bank_bits_, column_bits_;
+  vector<Bank> banks_;
+  vector<uint64_t> bus_free_; // Per channel, cycle the data bus frees up, 0 between untimed requests
+
+  DISALLOW_COPY_AND_ASSIGN(Dram);
+};
+
+// Build a configured DRAM, nullptr for an invalid config
+Dram *create_dram(const DramConfig &dc);
+
+// Comma separated list of the address mappings
+const char *dram_mapping_names();
+
+#endif //CACHE_DRAM_H_
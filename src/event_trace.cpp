@@ -0,0 +1,142 @@
+#include <cstring>
+#include "binary_trace.hpp"
+#include "event_trace.hpp"
+
+static atomic<uint64_t> next_tracer_id(1);
+
+static const char *EVENT_TYPE_NAMES[] = {"access", "prefetch", "evict", "writeback", "bypass"};
+
+const char *event_type_name(int type) {
+  return type >= 0 && type < kEventTypeNum ? EVENT_TYPE_NAMES[type] : nullptr;
+}
+
+EventTracer::EventTracer() : id_(0), file_(nullptr), record_num_(0), failed_(false) {}
+
+EventTracer::~EventTracer() {
+  if (file_)
+    fclose(file_);
+}
+
+bool EventTracer::Open(const string &path) {
+  if (file_)
+    fclose(file_);
+  file_ = path.empty() ? tmpfile() : fopen(path.c_str(), "w+b");
+  if (!file_)
+    return false;
+  id_ = next_tracer_id++;
+  buffers_.clear();
+  record_num_ = 0;
+  uint8_t header[EVENT_TRACE_HEADER_SIZE] = {0};
+  memcpy(header, EVENT_TRACE_MAGIC, sizeof(EVENT_TRACE_MAGIC));
+  put_u32(header + 8, EVENT_TRACE_VERSION);
+  put_u32(header + 12, EVENT_RECORD_SIZE);
+  failed_ = fwrite(header, 1, sizeof(header), file_) != sizeof(header);
+  return !failed_;
+}
+
+EventTracer::ThreadBuffer *EventTracer::NewBuffer() {
+  lock_guard<mutex> guard(lock_);
+  buffers_.emplace_back(new ThreadBuffer());
+  auto buffer = buffers_.back().get();
+  buffer->thread = (uint32_t) buffers_.size() - 1;
+  buffer->size = 0;
+  return buffer;
+}
+
+void EventTracer::Flush(ThreadBuffer &buffer) {
+  vector<uint8_t> chunk(8 + (size_t) buffer.size * EVENT_RECORD_SIZE);
+  put_u32(&chunk[0], buffer.thread);
+  put_u32(&chunk[4], buffer.size);
+  auto p = &chunk[8];
+  for (uint32_t i = 0; i < buffer.size; i++, p += EVENT_RECORD_SIZE) {
+    auto &record = buffer.records[i];
+    put_u64(p, record.addr);
+    put_u32(p + 8, (uint32_t) record.time);
+    p[12] = record.type;
+    p[13] = record.level;
+    p[14] = record.read;
+    p[15] = record.flag;
+  }
+  lock_guard<mutex> guard(lock_);
+  failed_ |= fwrite(chunk.data(), 1, chunk.size(), file_) != chunk.size();
+  record_num_ += buffer.size;
+  buffer.size = 0;
+}
+
+bool EventTracer::Finish() {
+  for (auto &buffer: buffers_) {
+    if (buffer->size)
+      Flush(*buffer);
+  }
+  failed_ |= fflush(file_) != 0;
+  rewind(file_);
+  return !failed_;
+}
+
+bool EventTracer::Decode(FILE *out) {
+  return decode_events(file_, out, 0, -1, false);
+}
+
+bool decode_events(FILE *in, FILE *out, int level, int type, bool summary) {
+  uint8_t header[EVENT_TRACE_HEADER_SIZE];
+  if (fread(header, 1, sizeof(header), in) != sizeof(header) ||
+      memcmp(header, EVENT_TRACE_MAGIC, sizeof(EVENT_TRACE_MAGIC)) ||
+      get_u32(header + 8) != EVENT_TRACE_VERSION || get_u32(header + 12) != EVENT_RECORD_SIZE)
+    return false;
+  vector<uint64_t> counts; // By level and type
+  vector<uint8_t> records;
+  uint8_t chunk[8];
+  size_t got;
+  while ((got = fread(chunk, 1, sizeof(chunk), in)) == sizeof(chunk)) {
+    uint32_t thread = get_u32(chunk), size = get_u32(chunk + 4);
+    if (size > EVENT_BUFFER_SIZE)
+      return false;
+    records.resize((size_t) size * EVENT_RECORD_SIZE);
+    if (fread(records.data(), 1, records.size(), in) != records.size())
+      return false;
+    for (auto p = records.data(); p < records.data() + records.size(); p += EVENT_RECORD_SIZE) {
+      auto name = event_type_name(p[12]);
+      if (!name)
+        return false;
+      if ((level && p[13] != level) || (type >= 0 && p[12] != type))
+        continue;
+      if (summary) {
+        size_t idx = (size_t) p[13] * kEventTypeNum + p[12];
+        if (counts.size() <= idx)
+          counts.resize(idx + 1, 0);
+        counts[idx]++;
+        continue;
+      }
+      uint64_t addr = get_u64(p);
+      int time = (int) get_u32(p + 8);
+      // Evictions and writebacks are of whole blocks, the rest of a read or write
+      bool block = p[12] == kEventEviction || p[12] == kEventWriteback;
+      fprintf(out, "[%u] L%d %-9s %s 0x%llx", thread, p[13], name, block ? "-" : p[14] ? "r" : "w",
+              (unsigned long long) addr);
+      switch (p[12]) {
+        case kEventAccess:
+          fprintf(out, " %s %d\n", p[15] ? "hit" : "miss", time);
+          break;
+        case kEventPrefetch:
+          fprintf(out, " %s\n", p[15] ? "hit" : "miss");
+          break;
+        case kEventEviction:
+          fprintf(out, " %s\n", p[15] ? "dirty" : "clean");
+          break;
+        case kEventWriteback:
+          fprintf(out, " %d\n", time);
+          break;
+        default:
+          fprintf(out, "\n");
+      }
+    }
+  }
+  if (got) // Truncated chunk header
+    return false;
+  for (size_t idx = 0; idx < counts.size(); idx++) {
+    if (counts[idx])
+      fprintf(out, "L%zu %-9s %llu\n", idx / kEventTypeNum, event_type_name(idx % kEventTypeNum),
+              (unsigned long long) counts[idx]);
+  }
+  return true;
+}
@@ -0,0 +1,111 @@
+#ifndef CACHE_EVENT_TRACE_H_
+#define CACHE_EVENT_TRACE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "storage.hpp"
+
+using namespace std;
+
+// Event file layout, all integers little-endian:
+//   header  magic, version, record size
+//   chunks  thread index and record count, then that many records of
+//           address, time, type, level, read and flag
+// Each chunk is one flushed thread buffer, so the events of a thread are in
+// order while those of different threads interleave by chunk.
+#define EVENT_TRACE_MAGIC "CSEVENT"
+#define EVENT_TRACE_VERSION 1
+#define EVENT_TRACE_HEADER_SIZE 16
+#define EVENT_RECORD_SIZE 16
+#define EVENT_BUFFER_SIZE 4096 // Records per thread buffer, written out when full
+
+enum EventType {
+  kEventAccess, // Demand access, flag is the hit, time its latency
+  kEventPrefetch, // Prefetch access, flag is the hit
+  kEventEviction, // A valid line made room, flag is whether it was dirty
+  kEventWriteback, // A dirty line went to the lower level, time its latency
+  kEventBypass, // A miss left the cache untouched
+  kEventTypeNum
+};
+
+typedef struct EventRecord_ {
+  uint64_t addr; // Block address for evictions and writebacks
+  int32_t time;
+  uint8_t type; // EventType
+  uint8_t level; // 1 for L1
+  uint8_t read;
+  uint8_t flag;
+} EventRecord;
+
+// Name of an EventType, nullptr if out of range
+const char *event_type_name(int type);
+
+// Collects events from any number of threads into one file. Each thread
+// fills a buffer of its own, which is written out under a lock when full,
+// so emitting is a store and an increment on the thread that simulates.
+class EventTracer {
+ public:
+  EventTracer();
+  ~EventTracer();
+
+  // Start a trace at path, or in an anonymous temporary file if path is empty
+  bool Open(const string &path);
+
+  void Emit(const EventRecord &record) {
+    auto buffer = Buffer();
+    buffer->records[buffer->size++] = record;
+    if (buffer->size == EVENT_BUFFER_SIZE)
+      Flush(*buffer);
+  }
+
+  // Write out every buffer once the simulating threads are done, false if
+  // writing failed. Keeps the file open and rewound for Decode().
+  bool Finish();
+
+  // Print the finished trace, see decode_events()
+  bool Decode(FILE *out);
+
+  uint64_t Size() const { return record_num_; }
+
+ private:
+  typedef struct ThreadBuffer_ {
+    uint32_t thread;
+    uint32_t size;
+    EventRecord records[EVENT_BUFFER_SIZE];
+  } ThreadBuffer;
+
+  // The calling thread's buffer, looked up once per thread and tracer
+  ThreadBuffer *Buffer() {
+    thread_local uint64_t owner = 0;
+    thread_local ThreadBuffer *buffer = nullptr;
+    if (owner != id_) {
+      buffer = NewBuffer();
+      owner = id_;
+    }
+    return buffer;
+  }
+
+  ThreadBuffer *NewBuffer();
+  void Flush(ThreadBuffer &buffer);
+
+  uint64_t id_; // Unique per Open(), so a thread never reuses a stale buffer
+  FILE *file_;
+  mutex lock_;
+  vector<unique_ptr<ThreadBuffer>> buffers_;
+  uint64_t record_num_;
+  bool failed_;
+
+  DISALLOW_COPY_AND_ASSIGN(EventTracer);
+};
+
+// Print the events of a trace file as text, optionally only those of one
+// level (0 for all) and type (-1 for all). With summary, print per level
+// and type counts instead. False if the file is malformed.
+bool decode_events(FILE *in, FILE *out, int level, int type, bool summary);
+
+#endif //CACHE_EVENT_TRACE_H_
@@ -0,0 +1,241 @@
+#include <cstring>
+#include <unordered_map>
+#include "config.hpp"
+#include "hierarchy.hpp"
+
+bool Hierarchy::Init(const HierarchyConfig &config) {
+  StorageStats stats;
+  memset(&stats, 0, sizeof(stats));
+  memset(&stats_, 0, sizeof(stats_));
+
+  levels_.clear();
+  latencies_.clear();
+  unique_now_.clear();
+  window_ = config.window;
+  bool prefetch = false;
+  for (auto &level: config.levels) {
+    // Misses only overlap in the timing model
+    auto cache = level.cache;
+    if (window_ <= 0)
+      cache.mshrs = 0;
+    levels_.emplace_back(create_cache(cache));
+    if (!levels_.back())
+      return false;
+    levels_.back()->SetStats(stats);
+    levels_.back()->SetLatency(level.latency);
+    latencies_.push_back(level.latency);
+    prefetch |= level.cache.prefetch > 0;
+    unique_now_.push_back(!prefetch);
+  }
+  mem_.reset(config.dram ? create_dram(config.dram_config) : new Memory());
+  if (levels_.empty() || !mem_)
+    return false;
+  for (size_t i = 0; i < levels_.size(); i++)
+    levels_[i]->SetLower(i + 1 < levels_.size() ? (Storage *) levels_[i + 1].get() : mem_.get());
+
+  // Init memory
+  mem_->SetStats(stats);
+  mem_->SetLatency(config.memory_latency);
+  mem_latency_ = config.memory_latency;
+  dram_ = config.dram;
+
+  batch_.resize(HIERARCHY_BATCH_SIZE);
+  results_.resize(HIERARCHY_BATCH_SIZE);
+  auto &l1_config = config.levels[0].cache;
+  buf_.assign(l1_config.tag_only ? 0 : l1_config.block_size, 0);
+  issue_ = 0;
+  outstanding_ = decltype(outstanding_)();
+  return true;
+}
+
+uint64_t Hierarchy::StateHash() const {
+  uint64_t hash = levels_[0]->StateHash(unique_now_[0]);
+  for (size_t i = 1; i < levels_.size(); i++)
+    hash = state_hash_step(hash, levels_[i]->StateHash(unique_now_[i]));
+  return state_hash_step(hash, mem_->StateHash());
+}
+
+// Every stat of the hierarchy at a pass boundary
+typedef struct PassStats_ {
+  vector<StorageStats> levels;
+  StorageStats mem;
+  HierarchyStats total;
+} PassStats;
+
+// Advance stat by cycles times its growth since then. The int64 result wraps
+// to int like the serial run's counters would.
+static int extrapolate(int stat, int then, int64_t cycles) {
+  return (int) (uint32_t) ((int64_t) stat + cycles * ((int64_t) stat - then));
+}
+
+static void extrapolate(StorageStats &stats, const StorageStats &then, int64_t cycles) {
+  stats.access_counter = extrapolate(stats.access_counter, then.access_counter, cycles);
+  stats.miss_num = extrapolate(stats.miss_num, then.miss_num, cycles);
+  stats.access_time = extrapolate(stats.access_time, then.access_time, cycles);
+  stats.replace_num = extrapolate(stats.replace_num, then.replace_num, cycles);
+  stats.fetch_num = extrapolate(stats.fetch_num, then.fetch_num, cycles);
+  stats.prefetch_num = extrapolate(stats.prefetch_num, then.prefetch_num, cycles);
+  stats.bypass_num = extrapolate(stats.bypass_num, then.bypass_num, cycles);
+  stats.bypass_miss_num = extrapolate(stats.bypass_miss_num, then.bypass_miss_num, cycles);
+  stats.keep_num = extrapolate(stats.keep_num, then.keep_num, cycles);
+  stats.dead_num = extrapolate(stats.dead_num, then.dead_num, cycles);
+  stats.useful_prefetch_num = extrapolate(stats.useful_prefetch_num, then.useful_prefetch_num, cycles);
+  stats.useless_prefetch_num = extrapolate(stats.useless_prefetch_num, then.useless_prefetch_num, cycles);
+  stats.polluting_prefetch_num = extrapolate(stats.polluting_prefetch_num, then.polluting_prefetch_num, cycles);
+  stats.merge_num = extrapolate(stats.merge_num, then.merge_num, cycles);
+  stats.mshr_stall_time = extrapolate(stats.mshr_stall_time, then.mshr_stall_time, cycles);
+  stats.byte_num = extrapolate(stats.byte_num, then.byte_num, cycles);
+  stats.row_hit_num = extrapolate(stats.row_hit_num, then.row_hit_num, cycles);
+  stats.row_conflict_num = extrapolate(stats.row_conflict_num, then.row_conflict_num, cycles);
+}
+
+void Hierarchy::AccessAll(const TraceRequest *reqs, size_t n, char *buf) {
+  if (window_ > 0)
+    return AccessTimed(reqs, n, buf);
+  for (size_t done = 0; done < n;) {
+    size_t size = min<size_t>(n - done, HIERARCHY_BATCH_SIZE);
+    for (size_t i = 0; i < size; i++)
+      batch_[i] = {reqs[done + i].addr, 1, reqs[done + i].read};
+    levels_[0]->HandleBatch(batch_.data(), size, buf, results_.data());
+    stats_.request_num += (int) size;
+    for (size_t i = 0; i < size; i++) {
+      stats_.hit_num += results_[i].hit;
+      stats_.time += results_[i].time;
+    }
+    done += size;
+  }
+}
+
+void Hierarchy::AccessTimed(const TraceRequest *reqs, size_t n, char *buf) {
+  for (size_t i = 0; i < n; i++) {
+    while (!outstanding_.empty() && outstanding_.top() <= issue_)
+      outstanding_.pop();
+    // A full window holds the request until the first outstanding one completes
+    if ((int) outstanding_.size() == window_) {
+      issue_ = outstanding_.top();
+      outstanding_.pop();
+    }
+    int hit, time;
+    levels_[0]->SetCycle(issue_);
+    Access(reqs[i], buf, hit, time);
+    uint64_t done = issue_ + time;
+    outstanding_.push(done);
+    stats_.cycles = max(stats_.cycles, (int) done);
+    issue_++;
+  }
+}
+
+void Hierarchy::Run(const vector<TraceRequest> &requests, int iter, bool extrapolate) {
+  char *buf = buf_.empty() ? nullptr : buf_.data();
+  auto pass = [&]() {
+    AccessAll(requests.data(), requests.size(), buf);
+  };
+  if (extrapolate)
+    RunPasses(iter, pass);
+  else
+    while (iter--)
+      pass();
+}
+
+int Hierarchy::RunPasses(int iter, const function<void()> &pass) {
+  unordered_map<uint64_t, int> seen; // Pass index by state hash at its start
+  vector<PassStats> starts; // Stats at the start of each pass
+  int simulated = 0;
+  if (window_ > 0) {
+    for (; simulated < iter; simulated++)
+      pass();
+    return simulated;
+  }
+  for (int i = 0; i < iter; i++) {
+    PassStats now;
+    now.levels.resize(levels_.size());
+    for (size_t j = 0; j < levels_.size(); j++)
+      levels_[j]->GetStats(now.levels[j]);
+    mem_->GetStats(now.mem);
+    now.total = stats_;
+    auto found = seen.emplace(StateHash(), i);
+    if (!found.second) {
+      auto &then = starts[found.first->second];
+      int period = i - found.first->second;
+      int64_t cycles = (iter - i) / period;
+      for (size_t j = 0; j < levels_.size(); j++)
+        extrapolate(now.levels[j], then.levels[j], cycles);
+      extrapolate(now.mem, then.mem, cycles);
+      now.total.request_num = extrapolate(now.total.request_num, then.total.request_num, cycles);
+      now.total.hit_num = extrapolate(now.total.hit_num, then.total.hit_num, cycles);
+      now.total.time = extrapolate(now.total.time, then.total.time, cycles);
+      for (size_t j = 0; j < levels_.size(); j++)
+        levels_[j]->SetStats(now.levels[j]);
+      mem_->SetStats(now.mem);
+      stats_ = now.total;
+      for (i += cycles * period; i < iter; i++, simulated++)
+        pass();
+      break;
+    }
+    starts.push_back(now);
+    pass();
+    simulated++;
+  }
+  return simulated;
+}
+
+double Hierarchy::Amat() const {
+  StorageStats stats;
+  mem_->GetStats(stats);
+  double amat = mem_latency_.hit_latency;
+  if (dram_ && stats.access_counter)
+    amat = (double) stats.access_time / stats.access_counter;
+  // From the last level up, each adds its own latency and its misses that of the levels below
+  for (size_t i = levels_.size(); i-- > 0;) {
+    levels_[i]->GetStats(stats);
+    double miss_rate = (double) stats.miss_num / stats.access_counter;
+    amat = latencies_[i].bus_latency + latencies_[i].hit_latency + miss_rate * amat;
+  }
+  return amat;
+}
+
+void preset_configs(bool optimize, bool tag_only, CacheConfig &l1, CacheConfig &l2) {
+  l1.size = L1_CACHE_SIZE;
+  l1.block_size = L1_BLOCK_SIZE;
+  l1.associativity = L1_CACHE_LINES;
+  l1.write_through = L1_WRITE_THROUGH;
+  l1.write_allocate = L1_WRITE_ALLOCATE;
+  l1.tag_only = tag_only;
+  if (optimize) {
+    l1.prefetch = 3;
+    l1.replacement = "plru";
+    l1.mct = 0;
+    l1.bypass = false;
+  } else {
+    l1.prefetch = 0;
+    l1.replacement = "lru";
+    l1.mct = 0;
+    l1.bypass = false;
+  }
+  l1.bypass_predictor = "mct";
+  l1.prefetcher = "next-line";
+  l1.prefetch_throttle = false;
+  l1.mshrs = 0;
+
+  l2.size = L2_CACHE_SIZE;
+  l2.block_size = L2_BLOCK_SIZE;
+  l2.associativity = L2_CACHE_LINES;
+  l2.write_through = L2_WRITE_THROUGH;
+  l2.write_allocate = L2_WRITE_ALLOCATE;
+  l2.tag_only = tag_only;
+  if (optimize) {
+    l2.prefetch = 3;
+    l2.replacement = "lru";
+    l2.mct = 1;
+    l2.bypass = true;
+  } else {
+    l2.prefetch = 0;
+    l2.replacement = "lru";
+    l2.mct = 0;
+    l2.bypass = false;
+  }
+  l2.bypass_predictor = "mct";
+  l2.prefetcher = "next-line";
+  l2.prefetch_throttle = false;
+  l2.mshrs = 0;
+}
@@ -0,0 +1,117 @@
+#ifndef CACHE_HIERARCHY_H_
+#define CACHE_HIERARCHY_H_
+
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <queue>
+#include "cache.hpp"
+#include "memory.hpp"
+#include "dram.hpp"
+#include "hierarchy_config.hpp"
+#include "trace.hpp"
+
+#define HIERARCHY_BATCH_SIZE 1024 // Requests per L1 HandleBatch call
+
+using namespace std;
+
+// Totals over the requests fed to a hierarchy
+typedef struct HierarchyStats_ {
+  int request_num;
+  int hit_num;
+  int time;
+  int cycles; // Timing mode: cycle the last request completed at
+} HierarchyStats;
+
+// Cache levels from L1 down to memory, L1 -> L2 -> memory with the
+// latencies from config.hpp unless configured otherwise. Owns its levels, so
+// independent hierarchies can run on different threads.
+class Hierarchy {
+ public:
+  Hierarchy() : window_(0), issue_(0) {}
+  ~Hierarchy() {}
+
+  // False if any config is invalid or there is no cache level
+  bool Init(const HierarchyConfig &config);
+
+  // Two levels, see two_level_config()
+  bool Init(const CacheConfig &l1_config, const CacheConfig &l2_config, const DramConfig *dram_config = nullptr) {
+    return Init(two_level_config(l1_config, l2_config, dram_config));
+  }
+
+  // Issue one trace request to L1, buf holds a block or is nullptr if tag only
+  void Access(const TraceRequest &req, char *buf, int &hit, int &time) {
+    levels_[0]->HandleRequest(req.addr, 1, req.read, buf, hit, time);
+    stats_.request_num++;
+    stats_.hit_num += hit;
+    stats_.time += time;
+  }
+
+  // HierarchyConfig::window: requests are issued one per cycle in trace
+  // order, stalling while window of them are outstanding. Misses only overlap
+  // in caches with CacheConfig::mshrs.
+  int Window() const { return window_; }
+
+  // Issue reqs[0, n) in order like Access, as Storage::HandleBatch batches
+  // of up to HIERARCHY_BATCH_SIZE requests, or one at a time in timing mode
+  void AccessAll(const TraceRequest *reqs, size_t n, char *buf);
+
+  // Run the whole trace iter times, extrapolating once the state repeats
+  // unless the caches are still busy elsewhere when a pass ends
+  void Run(const vector<TraceRequest> &requests, int iter, bool extrapolate = true);
+
+  // Call pass iter times, each issuing one pass over the trace. Once the state
+  // at the start of a pass matches the start of an earlier one, the passes in
+  // between recur forever, so whole periods of them are added to the stats
+  // arithmetically and only the leftover passes are simulated. The cache
+  // state then matches the serial run up to renumbered recency stamps.
+  // Returns the number of passes simulated. Timing mode state is left out
+  // of the hash, so timed runs simulate every pass.
+  int RunPasses(int iter, const function<void()> &pass);
+
+  // Hash of the state of every level and memory, see Cache::StateHash()
+  uint64_t StateHash() const;
+
+  // Send the events of each level to tracer, L1 as level 1, nullptr to stop
+  void SetTracer(EventTracer *tracer) {
+    for (size_t i = 0; i < levels_.size(); i++)
+      levels_[i]->SetTracer(tracer, (int) i + 1);
+  }
+
+  int Levels() const { return (int) levels_.size(); }
+  Cache *Level(int i) const { return levels_[i].get(); } // 0 for L1
+  Cache *L1() const { return Level(0); }
+  Cache *L2() const { return Level(1); } // Only with two levels or more
+  Memory *Mem() const { return mem_.get(); }
+  const HierarchyStats &GetStats() const { return stats_; }
+  void SetStats(const HierarchyStats &hs) { stats_ = hs; }
+
+  // Average memory access time in cycles from the miss rate of each level,
+  // with the average latency of a DRAM memory
+  double Amat() const;
+
+ private:
+  // AccessAll() in timing mode
+  void AccessTimed(const TraceRequest *reqs, size_t n, char *buf);
+
+  vector<unique_ptr<Cache>> levels_; // From L1 down
+  vector<StorageLatency> latencies_;
+  vector<bool> unique_now_; // Per level, no prefetches reach it, see Cache::StateHash()
+  unique_ptr<Memory> mem_;
+  StorageLatency mem_latency_;
+  HierarchyStats stats_;
+  bool dram_;
+  vector<AccessRequest> batch_; // AccessAll buffers
+  vector<AccessResult> results_;
+  vector<char> buf_; // Block buffer for Run(), empty if tag only
+  int window_;
+  uint64_t issue_; // Timing mode: cycle the next request issues at
+  priority_queue<uint64_t, vector<uint64_t>, greater<uint64_t>> outstanding_; // Their completion cycles
+
+  DISALLOW_COPY_AND_ASSIGN(Hierarchy);
+};
+
+// Default or --optimized L1/L2 configs from config.hpp
+void preset_configs(bool optimize, bool tag_only, CacheConfig &l1, CacheConfig &l2);
+
+#endif //CACHE_HIERARCHY_H_
@@ -0,0 +1,230 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include "config.hpp"
+#include "hierarchy_config.hpp"
+
+#define MAX_LEVELS 16 // Deepest hierarchy a config may describe
+
+uint64_t parse_size(const string &text) {
+  char *end;
+  uint64_t size = strtoull(text.c_str(), &end, 10);
+  if (end == text.c_str())
+    return 0;
+  switch (toupper(*end)) {
+    case 'K': size <<= 10, end++; break;
+    case 'M': size <<= 20, end++; break;
+    case 'G': size <<= 30, end++; break;
+  }
+  return *end ? 0 : size;
+}
+
+string format_size(uint64_t size) {
+  const char *units[] = {"B", "KB", "MB", "GB"};
+  int unit = 0;
+  while (unit < 3 && size >= 1024 && size % 1024 == 0)
+    size /= 1024, unit++;
+  return to_string(size) + units[unit];
+}
+
+static bool parse_int(const string &text, int &value) {
+  char *end;
+  long x = strtol(text.c_str(), &end, 10);
+  if (end == text.c_str() || *end || x < 0 || x > INT32_MAX)
+    return false;
+  value = x;
+  return true;
+}
+
+static bool parse_size_int(const string &text, int &value) {
+  uint64_t size = parse_size(text);
+  if (!size || size > INT32_MAX)
+    return false;
+  value = size;
+  return true;
+}
+
+static bool parse_bool(const string &text, bool &value) {
+  if (text == "1" || text == "true")
+    value = true;
+  else if (text == "0" || text == "false")
+    value = false;
+  else
+    return false;
+  return true;
+}
+
+static string to_lower(string text) {
+  transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return tolower(c); });
+  return text;
+}
+
+static string trim(const string &text) {
+  auto begin = text.find_first_not_of(" \t\r");
+  if (begin == string::npos)
+    return "";
+  return text.substr(begin, text.find_last_not_of(" \t\r") + 1 - begin);
+}
+
+void default_dram_config(DramConfig &dc) {
+  dc.channels = DRAM_CHANNELS;
+  dc.ranks = DRAM_RANKS;
+  dc.banks = DRAM_BANKS;
+  dc.row_size = DRAM_ROW_SIZE;
+  dc.t_rcd = DRAM_T_RCD;
+  dc.t_cas = DRAM_T_CAS;
+  dc.t_rp = DRAM_T_RP;
+  dc.t_burst = DRAM_T_BURST;
+  dc.open_page = true;
+  dc.mapping = "page";
+  dc.timed = false;
+}
+
+HierarchyConfig two_level_config(const CacheConfig &l1, const CacheConfig &l2, const DramConfig *dram_config) {
+  HierarchyConfig hc;
+  hc.levels.push_back({l1, {L1_HIT_LATENCY, L1_BUS_LATENCY}});
+  hc.levels.push_back({l2, {L2_HIT_LATENCY, L2_BUS_LATENCY}});
+  hc.memory_latency = {MEM_HIT_LATENCY, MEM_BUS_LATENCY};
+  hc.dram = dram_config != nullptr;
+  if (dram_config)
+    hc.dram_config = *dram_config;
+  else
+    default_dram_config(hc.dram_config);
+  hc.window = 0;
+  return hc;
+}
+
+bool apply_level_setting(LevelConfig &level, const string &field, const string &value) {
+  auto cc = &level.cache;
+  if (field == "size")
+    return parse_size_int(value, cc->size);
+  if (field == "replacement") {
+    cc->replacement = value;
+    return true;
+  }
+  if (field == "assoc")
+    return parse_int(value, cc->associativity);
+  if (field == "block")
+    return parse_int(value, cc->block_size);
+  if (field == "prefetch")
+    return parse_int(value, cc->prefetch);
+  if (field == "prefetcher")
+    return set_prefetcher(*cc, value);
+  if (field == "throttle")
+    return parse_bool(value, cc->prefetch_throttle);
+  if (field == "mct")
+    return parse_int(value, cc->mct);
+  if (field == "bypass") {
+    // 0 and 1 turn the current predictor off and on, a name picks another
+    bool on;
+    if (parse_bool(value, on))
+      return set_bypass_predictor(*cc, on ? cc->bypass_predictor : "none");
+    return set_bypass_predictor(*cc, value);
+  }
+  if (field == "write-through")
+    return parse_bool(value, cc->write_through);
+  if (field == "write-allocate")
+    return parse_bool(value, cc->write_allocate);
+  if (field == "mshrs")
+    return parse_int(value, cc->mshrs);
+  if (field == "hit-latency")
+    return parse_int(value, level.latency.hit_latency);
+  if (field == "bus-latency")
+    return parse_int(value, level.latency.bus_latency);
+  return false;
+}
+
+static bool apply_memory_setting(HierarchyConfig &hc, const string &field, const string &value) {
+  auto dc = &hc.dram_config;
+  if (field == "type") {
+    if (value != "flat" && value != "dram")
+      return false;
+    hc.dram = value == "dram";
+    return true;
+  }
+  if (field == "hit-latency")
+    return parse_int(value, hc.memory_latency.hit_latency);
+  if (field == "bus-latency")
+    return parse_int(value, hc.memory_latency.bus_latency);
+  if (field == "channels")
+    return parse_int(value, dc->channels);
+  if (field == "ranks")
+    return parse_int(value, dc->ranks);
+  if (field == "banks")
+    return parse_int(value, dc->banks);
+  if (field == "row-size")
+    return parse_size_int(value, dc->row_size);
+  if (field == "trcd")
+    return parse_int(value, dc->t_rcd);
+  if (field == "tcas")
+    return parse_int(value, dc->t_cas);
+  if (field == "trp")
+    return parse_int(value, dc->t_rp);
+  if (field == "tburst")
+    return parse_int(value, dc->t_burst);
+  if (field == "page") {
+    if (value != "open" && value != "closed")
+      return false;
+    dc->open_page = value == "open";
+    return true;
+  }
+  if (field == "mapping") {
+    dc->mapping = value;
+    return true;
+  }
+  return false;
+}
+
+// Grow or shrink to levels, new levels copy the last one
+static bool resize_levels(HierarchyConfig &hc, int levels) {
+  if (levels < 1 || levels > MAX_LEVELS || hc.levels.empty())
+    return false;
+  hc.levels.resize(levels, hc.levels.back());
+  return true;
+}
+
+bool apply_hierarchy_setting(HierarchyConfig &hc, const string &key, const string &value) {
+  auto name = to_lower(key);
+  if (name == "levels") {
+    int levels;
+    return parse_int(value, levels) && resize_levels(hc, levels);
+  }
+  auto dot = name.find('.');
+  if (dot == string::npos)
+    return false;
+  auto section = name.substr(0, dot), field = name.substr(dot + 1);
+  if (section == "memory")
+    return apply_memory_setting(hc, field, value);
+  int level;
+  if (section.size() < 2 || section[0] != 'l' || !parse_int(section.substr(1), level) || level < 1 ||
+      level > (int) hc.levels.size() + 1)
+    return false;
+  if (level > (int) hc.levels.size() && !resize_levels(hc, level))
+    return false;
+  return apply_level_setting(hc.levels[level - 1], field, value);
+}
+
+bool load_hierarchy_config(const string &path, HierarchyConfig &hc) {
+  ifstream file(path);
+  if (!file) {
+    cerr << "Can't open config " << path << endl;
+    return false;
+  }
+  string line, prefix;
+  for (int line_num = 1; getline(file, line); line_num++) {
+    line = trim(line.substr(0, line.find_first_of(";#")));
+    if (line.empty())
+      continue;
+    if (line.front() == '[' && line.back() == ']') {
+      prefix = trim(line.substr(1, line.size() - 2)) + ".";
+      continue;
+    }
+    auto eq = line.find('=');
+    if (eq == string::npos ||
+        !apply_hierarchy_setting(hc, prefix + trim(line.substr(0, eq)), trim(line.substr(eq + 1)))) {
+      cerr << "Invalid setting " << line << " on line " << line_num << " of " << path << endl;
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,66 @@
+#ifndef CACHE_HIERARCHY_CONFIG_H_
+#define CACHE_HIERARCHY_CONFIG_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "cache.hpp"
+#include "dram.hpp"
+
+using namespace std;
+
+// One cache level
+typedef struct LevelConfig_ {
+  CacheConfig cache;
+  StorageLatency latency;
+} LevelConfig;
+
+// Cache levels from L1 down and the memory below the last one
+typedef struct HierarchyConfig_ {
+  vector<LevelConfig> levels;
+  StorageLatency memory_latency; // hit_latency is only used by the flat memory
+  bool dram; // DRAM back end in place of the flat memory
+  DramConfig dram_config;
+  // Requests in flight in the non-blocking timing model, 0 for the serial
+  // model where the levels ignore their mshrs
+  int window;
+} HierarchyConfig;
+
+// DRAM defaults from config.hpp
+void default_dram_config(DramConfig &dc);
+
+// L1 -> L2 -> memory with the latencies from config.hpp, the flat memory
+// unless dram_config is given
+HierarchyConfig two_level_config(const CacheConfig &l1, const CacheConfig &l2,
+                                 const DramConfig *dram_config = nullptr);
+
+// Set field of a cache level to value, field one of size, assoc, block,
+// replacement, prefetch, prefetcher, throttle, mct, bypass, write-through,
+// write-allocate, mshrs, hit-latency or bus-latency. Sizes accept K/M/G
+// suffixes. prefetcher and bypass take names as set_prefetcher() and
+// set_bypass_predictor() do, bypass also 0 or 1 to turn the current
+// predictor off or on. False for an unknown field or a malformed value.
+bool apply_level_setting(LevelConfig &level, const string &field, const string &value);
+
+// Set key of hc to value. Keys are levels, the number of cache levels,
+// l<n>.<field> with the fields above and memory.<field> with field one of
+// type (flat or dram), hit-latency, bus-latency, channels, ranks, banks,
+// row-size, trcd, tcas, trp, tburst, page (open or closed) or mapping.
+// Levels added by either copy the last level, so l<n> may also name the
+// level right below it. False for an unknown key or a malformed value.
+bool apply_hierarchy_setting(HierarchyConfig &hc, const string &key, const string &value);
+
+// Apply an INI file to hc. Each "key = value" line is a setting as above,
+// prefixed by the section it is in: [L2] holds l2. settings, [memory]
+// memory. ones, and lines before any section take whole keys such as
+// levels. Blank lines and ; or # comments are skipped. Reports the bad line
+// on failure.
+bool load_hierarchy_config(const string &path, HierarchyConfig &hc);
+
+// Bytes of a size such as 4096, 32K or 8M, 0 if malformed
+uint64_t parse_size(const string &text);
+
+// Size in the largest exact unit, e.g. 32KB
+string format_size(uint64_t size);
+
+#endif //CACHE_HIERARCHY_CONFIG_H_
@@ -1,30 +1,90 @@
 #include <iostream>
 #include <fstream>
+#include <cstring>
+#include <utility>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <sstream>
 #include <argparse/argparse.hpp>
 #include "config.hpp"
 #include "cache.hpp"
 #include "memory.hpp"
+#include "hierarchy.hpp"
+#include "trace.hpp"
+#include "binary_trace.hpp"
+#include "text_trace.hpp"
+#include "trace_stream.hpp"
+#include "stack_distance.hpp"
+#include "sweep.hpp"
+#include "shard.hpp"
+#include "pipeline.hpp"
+#include "miss_stream.hpp"
+#include "event_trace.hpp"
+
+#define CONVERT_CHUNK_SIZE (16 << 20)
+#define REPLAY_CHUNK_SIZE 4096 // Binary trace requests decoded per Hierarchy::AccessAll
 
 using namespace std;
 
 string trace_path;
-CacheConfig l1_config, l2_config;
+HierarchyConfig hierarchy_config;
+Hierarchy hierarchy;
 Memory *mem;
 Cache *l1;
 Cache *l2;
-int total_hit, total_time, total_request, iter;
+int iter, threads, shards;
+int window, mshrs; // Timing mode if window > 0
+double sample_sets; // Fraction of the shards simulated, 1 for all of them
+ShardedHierarchy sharded;
+vector<TraceRequest> requests;
+BinaryTraceReader binary_trace;
+bool binary_input;
+bool stream_input;
+bool miss_input; // trace_path is a recorded L1 miss stream
+MissStreamHeader miss_header;
+vector<PipelineRecord> miss_records;
+string record_path;
+MissStreamWriter miss_writer;
+string events_path;
+EventTracer tracer;
+double parse_seconds, simulate_seconds;
+int simulated_passes; // Of the iter passes, the rest were extrapolated
 
 bool verbose = false;
 bool optimize = false;
+bool tag_only = false;
+bool pipeline = false;
+bool extrapolate = true; // Skip the --iter passes after the state repeats
+
+// A miss stream replays the L1 it was recorded with: L1 must keep the
+// recorded config and L2 blocks must hold a whole L1 block
+bool check_miss_stream_config(const MissStreamHeader &header, const CacheConfig &l1, const CacheConfig &l2) {
+  auto &recorded = header.l1_config;
+  if (l1.size != recorded.size || l1.associativity != recorded.associativity ||
+      l1.block_size != recorded.block_size || l1.replacement != recorded.replacement ||
+      l1.prefetch != recorded.prefetch || l1.mct != recorded.mct || l1.bypass != recorded.bypass ||
+      l1.bypass_predictor != recorded.bypass_predictor || l1.prefetcher != recorded.prefetcher ||
+      l1.prefetch_throttle != recorded.prefetch_throttle ||
+      l1.write_through != recorded.write_through || l1.write_allocate != recorded.write_allocate) {
+    cerr << "L1 settings are fixed by the recorded miss stream" << endl;
+    return false;
+  }
+  if (l2.block_size < recorded.block_size) {
+    cerr << "L2 blocks must be at least the " << recorded.block_size << " byte L1 blocks of the miss stream" << endl;
+    return false;
+  }
+  return true;
+}
 
 void parse_args(int argc, char *argv[]) {
   argparse::ArgumentParser parser("cache-simulator");
 
   parser.add_argument("trace-path")
-      .help("Path to trace file");
+      .help("Path to trace file, - for stdin");
 
   parser.add_argument("--verbose")
-      .help("Verbose mode")
+      .help("Print every cache event to stderr after the run")
       .default_value(false)
       .implicit_value(true);
 
@@ -33,11 +93,118 @@ void parse_args(int argc, char *argv[]) {
       .default_value(false)
       .implicit_value(true);
 
+  parser.add_argument("--tag-only")
+      .help("Simulate tags only, skipping block payloads")
+      .default_value(false)
+      .implicit_value(true);
+
+  parser.add_argument("--config")
+      .help("Hierarchy config file of [L1], [L2], ... and [memory] sections, see README");
+
+  parser.add_argument("--set")
+      .help("Override a hierarchy setting such as l3.size=4M or memory.type=dram, after --config")
+      .append();
+
+  parser.add_argument("--l1-replacement")
+      .help(string("L1 replacement policy, one of ") + replacement_policy_names());
+
+  parser.add_argument("--l2-replacement")
+      .help(string("L2 replacement policy, one of ") + replacement_policy_names());
+
+  parser.add_argument("--l1-bypass")
+      .help(string("L1 bypass predictor, one of none, ") + bypass_predictor_names());
+
+  parser.add_argument("--l2-bypass")
+      .help(string("L2 bypass predictor, one of none, ") + bypass_predictor_names());
+
+  parser.add_argument("--l1-prefetcher")
+      .help(string("L1 prefetcher, one of none, ") + prefetcher_names());
+
+  parser.add_argument("--l2-prefetcher")
+      .help(string("L2 prefetcher, one of none, ") + prefetcher_names());
+
+  parser.add_argument("--prefetch-throttle")
+      .help("Adapt the prefetch degree of each level to its accuracy")
+      .default_value(false)
+      .implicit_value(true);
+
   parser.add_argument("--iter")
       .help("Trace iteration count")
       .default_value(10)
       .scan<'i', int>();;
 
+  parser.add_argument("--no-extrapolate")
+      .help("Simulate every --iter pass, even after the cache state repeats at a pass boundary")
+      .default_value(false)
+      .implicit_value(true);
+
+  parser.add_argument("--stream")
+      .help("Simulate while reading the trace from a pipe or FIFO, implied by trace path -")
+      .default_value(false)
+      .implicit_value(true);
+
+  parser.add_argument("--threads")
+      .help("Trace parser and shard threads, 0 for one per hardware thread")
+      .default_value(0)
+      .scan<'i', int>();
+
+  parser.add_argument("--shards")
+      .help("Split the sets into this many independently simulated shards, a power of two, 0 for a serial run")
+      .default_value(0)
+      .scan<'i', int>();
+
+  parser.add_argument("--sample-sets")
+      .help("Simulate only this fraction of the sets, picked as whole shards, and scale up the stats")
+      .default_value(1.0)
+      .scan<'g', double>();
+
+  parser.add_argument("--pipeline")
+      .help("Simulate L1 and L2 on separate threads, tag only")
+      .default_value(false)
+      .implicit_value(true);
+
+  parser.add_argument("--record-misses")
+      .help("Also write the requests L1 sends to L2 to this file, which replays in place of the trace");
+
+  parser.add_argument("--window")
+      .help("Issue the trace non-blocking with up to this many requests outstanding, 0 for the serial model")
+      .default_value(0)
+      .scan<'i', int>();
+
+  parser.add_argument("--mshrs")
+      .help("Misses each cache keeps in flight in the non-blocking model, see --window")
+      .default_value(8)
+      .scan<'i', int>();
+
+  parser.add_argument("--dram")
+      .help("Simulate DRAM banks and row buffers in place of the flat memory latency")
+      .default_value(false)
+      .implicit_value(true);
+
+  parser.add_argument("--dram-channels")
+      .help("DRAM channels, a power of two");
+
+  parser.add_argument("--dram-ranks")
+      .help("DRAM ranks per channel, a power of two");
+
+  parser.add_argument("--dram-banks")
+      .help("DRAM banks per rank, a power of two");
+
+  parser.add_argument("--dram-row-size")
+      .help("Bytes per DRAM row, a power of two");
+
+  parser.add_argument("--dram-timings")
+      .help("DRAM tRCD,tCAS,tRP,tBURST in cycles");
+
+  parser.add_argument("--dram-page")
+      .help("DRAM page policy, open or closed");
+
+  parser.add_argument("--dram-mapping")
+      .help(string("DRAM address mapping, one of ") + dram_mapping_names());
+
+  parser.add_argument("--trace-events")
+      .help("Write every access, prefetch, eviction, writeback and bypass to this file, see cache-simulator events");
+
   try {
     parser.parse_args(argc, argv);
   }
@@ -50,145 +217,877 @@ void parse_args(int argc, char *argv[]) {
   trace_path = parser.get<string>("trace-path");
   verbose = parser.get<bool>("--verbose");
   optimize = parser.get<bool>("--optimized");
+  tag_only = parser.get<bool>("--tag-only");
   iter = parser.get<int>("--iter");
+  extrapolate = !parser.get<bool>("--no-extrapolate");
+  threads = parser.get<int>("--threads");
+  shards = parser.get<int>("--shards");
+  sample_sets = parser.get<double>("--sample-sets");
+  pipeline = parser.get<bool>("--pipeline");
+  window = parser.get<int>("--window");
+  mshrs = parser.get<int>("--mshrs");
+  if (window < 0 || mshrs < 1) {
+    cerr << "--window must be at least 0 and --mshrs at least 1" << endl;
+    exit(1);
+  }
+  if (parser.is_used("--mshrs") && !window)
+    cerr << "--mshrs is ignored without --window" << endl;
+  if (auto path = parser.present("--record-misses"))
+    record_path = *path;
+  if (auto path = parser.present("--trace-events"))
+    events_path = *path;
+  stream_input = parser.get<bool>("--stream") || trace_path == "-";
+  if (stream_input) {
+    if (parser.is_used("--iter") && iter != 1)
+      cerr << "--iter is ignored for streamed traces" << endl;
+    iter = 1;
+  }
+  if (!(sample_sets > 0 && sample_sets <= 1)) {
+    cerr << "--sample-sets must be in (0, 1]" << endl;
+    exit(1);
+  }
+  // Set sampling runs on the sharded engine
+  bool sharded_run = shards || sample_sets < 1;
+  const char *sharded_option = shards ? "--shards" : "--sample-sets";
+  if (sharded_run && pipeline) {
+    cerr << sharded_option << " and --pipeline can't be combined" << endl;
+    exit(1);
+  }
+  if ((sharded_run || pipeline) && stream_input) {
+    cerr << (sharded_run ? sharded_option : "--pipeline") << " needs a trace file" << endl;
+    exit(1);
+  }
+  if ((sharded_run || pipeline) && !record_path.empty()) {
+    cerr << "--record-misses needs a serial run" << endl;
+    exit(1);
+  }
+  miss_input = !stream_input && is_miss_stream(trace_path);
+  if (miss_input) {
+    if (sharded_run || pipeline || !record_path.empty()) {
+      cerr << "A miss stream can only be replayed serially" << endl;
+      exit(1);
+    }
+    if (parser.is_used("--iter"))
+      cerr << "--iter is ignored for miss streams, they hold every recorded iteration" << endl;
+    if (parser.is_used("--l1-replacement") || parser.is_used("--l1-bypass") || parser.is_used("--l1-prefetcher")) {
+      cerr << "L1 settings are fixed by the recorded miss stream" << endl;
+      exit(1);
+    }
+    if (!load_miss_stream_header(trace_path, miss_header)) {
+      cerr << "Malformed miss stream " << trace_path << endl;
+      exit(1);
+    }
+    tag_only = true; // Records carry no content
+  }
+  // The timing model follows every request through live caches
+  if ((sharded_run || pipeline || miss_input || !record_path.empty()) && window) {
+    cerr << "--window needs a serial run of a trace" << endl;
+    exit(1);
+  }
+  if ((sharded_run || pipeline) && !events_path.empty()) {
+    cerr << "--trace-events needs a serial run" << endl;
+    exit(1);
+  }
+  if ((sharded_run || pipeline) && verbose) {
+    cerr << "--verbose is ignored with " << (sharded_run ? sharded_option : "--pipeline") << endl;
+    verbose = false;
+  }
 
-  l1_config.size = L1_CACHE_SIZE;
-  l1_config.block_size = L1_BLOCK_SIZE;
-  l1_config.associativity = L1_CACHE_LINES;
-  l1_config.write_through = L1_WRITE_THROUGH;
-  l1_config.write_allocate = L1_WRITE_ALLOCATE;
-  if (optimize) {
-    l1_config.prefetch = 3;
-    l1_config.replacement = "plru";
-    l1_config.mct = 0;
-    l1_config.bypass = false;
-  } else {
-    l1_config.prefetch = 0;
-    l1_config.replacement = "lru";
-    l1_config.mct = 0;
-    l1_config.bypass = false;
+  // Presets, then the config file, --set and the options of single levels
+  CacheConfig l1_preset, l2_preset;
+  preset_configs(optimize, tag_only, l1_preset, l2_preset);
+  hierarchy_config = two_level_config(l1_preset, l2_preset);
+  if (auto path = parser.present("--config")) {
+    if (!load_hierarchy_config(*path, hierarchy_config))
+      exit(1);
+  }
+  // A replayed L1 is the recorded one, --set must leave it alone
+  if (miss_input)
+    hierarchy_config.levels[0].cache = miss_header.l1_config;
+  vector<pair<string, string>> settings;
+  if (parser.is_used("--set")) {
+    for (auto &setting: parser.get<vector<string>>("--set")) {
+      auto eq = setting.find('=');
+      settings.push_back({setting.substr(0, eq), eq == string::npos ? "" : setting.substr(eq + 1)});
+    }
+  }
+  // The DRAM options are shorthands of memory settings
+  if (parser.get<bool>("--dram"))
+    settings.push_back({"memory.type", "dram"});
+  for (auto option: {"channels", "ranks", "banks", "row-size", "page", "mapping"}) {
+    if (auto value = parser.present(string("--dram-") + option))
+      settings.push_back({string("memory.") + option, *value});
+  }
+  if (auto timings = parser.present("--dram-timings")) {
+    stringstream values(*timings);
+    string value;
+    for (auto field: {"trcd", "tcas", "trp", "tburst"})
+      settings.push_back({string("memory.") + field, getline(values, value, ',') ? value : ""});
+  }
+  for (auto &setting: settings) {
+    if (!apply_hierarchy_setting(hierarchy_config, setting.first, setting.second)) {
+      cerr << "Invalid setting " << setting.first << "=" << setting.second << endl;
+      exit(1);
+    }
+  }
+  for (auto option: {"--dram-channels", "--dram-ranks", "--dram-banks", "--dram-row-size", "--dram-timings",
+                     "--dram-page", "--dram-mapping"}) {
+    if (parser.is_used(option) && !hierarchy_config.dram)
+      cerr << option << " is ignored without a DRAM memory" << endl;
+  }
+  auto &levels = hierarchy_config.levels;
+  if (levels.size() < 2 && (miss_input || !record_path.empty() || pipeline || parser.is_used("--l2-replacement") ||
+                            parser.is_used("--l2-bypass") || parser.is_used("--l2-prefetcher"))) {
+    cerr << "Miss streams, --pipeline and L2 options need two cache levels" << endl;
+    exit(1);
+  }
+  for (auto &level: levels)
+    level.cache.tag_only = tag_only;
+  if (auto policy = parser.present("--l1-replacement"))
+    levels[0].cache.replacement = *policy;
+  if (auto policy = parser.present("--l2-replacement"))
+    levels[1].cache.replacement = *policy;
+  for (size_t i = 0; i < levels.size(); i++) {
+    auto config = &levels[i].cache;
+    unique_ptr<ReplacementPolicy> policy(create_replacement_policy(config->replacement));
+    if (!policy) {
+      cerr << "Unknown replacement policy " << config->replacement << ", expected one of "
+           << replacement_policy_names() << endl;
+      exit(1);
+    }
+    if (parser.get<bool>("--prefetch-throttle"))
+      config->prefetch_throttle = true;
+    // Config mshrs only count in the timing model, where --mshrs stands in for the levels without any
+    if (!window)
+      config->mshrs = 0;
+    else if (parser.is_used("--mshrs") || !config->mshrs)
+      config->mshrs = mshrs;
+    if (i >= 2)
+      continue;
+    auto prefetcher = parser.present(i == 0 ? "--l1-prefetcher" : "--l2-prefetcher");
+    if (prefetcher && !set_prefetcher(*config, *prefetcher)) {
+      cerr << "Unknown prefetcher " << *prefetcher << ", expected one of none, " << prefetcher_names() << endl;
+      exit(1);
+    }
+    auto predictor = parser.present(i == 0 ? "--l1-bypass" : "--l2-bypass");
+    if (predictor && !set_bypass_predictor(*config, *predictor)) {
+      cerr << "Unknown bypass predictor " << *predictor << ", expected one of none, " << bypass_predictor_names()
+           << endl;
+      exit(1);
+    }
+  }
+  if (miss_input && !check_miss_stream_config(miss_header, levels[0].cache, levels[1].cache))
+    exit(1);
+  hierarchy_config.dram_config.timed = window > 0;
+  hierarchy_config.window = window;
+  // Sample from as many shards as the configs allow unless told otherwise
+  if (sample_sets < 1 && !shards && !(shards = max_shards(hierarchy_config))) {
+    cerr << "--sample-sets needs caches of at least 4 sets" << endl;
+    exit(1);
   }
+}
 
+void init_cache() {
+  if (!hierarchy.Init(hierarchy_config)) {
+    cerr << (hierarchy_config.dram ? "Invalid cache or DRAM config" : "Invalid cache config") << endl;
+    exit(1);
+  }
+  l1 = hierarchy.L1();
+  l2 = hierarchy.Levels() > 1 ? hierarchy.L2() : nullptr;
+  mem = hierarchy.Mem();
+  if (!record_path.empty()) {
+    if (!miss_writer.Open(record_path, l1, l2, hierarchy_config.levels[0].cache)) {
+      cerr << "Can't create " << record_path << endl;
+      exit(1);
+    }
+    l1->SetLower(&miss_writer);
+  }
+  // Verbose mode decodes a temporary trace unless one is kept anyway
+  if (verbose || !events_path.empty()) {
+    if (!tracer.Open(events_path)) {
+      cerr << "Can't create " << events_path << endl;
+      exit(1);
+    }
+    hierarchy.SetTracer(&tracer);
+  }
+}
 
+double seconds_since(chrono::steady_clock::time_point start) {
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
 
-  l2_config.size = L2_CACHE_SIZE;
-  l2_config.block_size = L2_BLOCK_SIZE;
-  l2_config.associativity = L2_CACHE_LINES;
-  l2_config.write_through = L2_WRITE_THROUGH;
-  l2_config.write_allocate = L2_WRITE_ALLOCATE;
-  if (optimize) {
-    l2_config.prefetch = 3;
-    l2_config.replacement = "lru";
-    l2_config.mct = 1;
-    l2_config.bypass = true;
-  } else {
-    l2_config.prefetch = 0;
-    l2_config.replacement = "lru";
-    l2_config.mct = 0;
-    l2_config.bypass = false;
+void load_requests() {
+  if (stream_input) // Parsed on the reader thread while simulating
+    return;
+  auto start = chrono::steady_clock::now();
+  if (miss_input) {
+    if (!load_miss_stream(trace_path, miss_header, miss_records)) {
+      cerr << "Malformed miss stream " << trace_path << endl;
+      exit(1);
+    }
+    parse_seconds = seconds_since(start);
+    return;
   }
+  // Binary traces are replayed straight from the mapping, text traces are decoded
+  // once, and so are binary traces for the sharded and pipelined engines
+  binary_input = !shards && !pipeline && is_binary_trace(trace_path);
+  bool ok = binary_input ? binary_trace.Open(trace_path) : load_trace(trace_path, requests, threads);
+  if (!ok) {
+    cerr << "Can't open trace " << trace_path << endl;
+    exit(1);
+  }
+  parse_seconds = seconds_since(start);
 }
 
-void init_cache() {
-  StorageStats stats;
-  memset(&stats, 0, sizeof(stats));
+void handle_requests(const TraceRequest *reqs, size_t n, char *buf) {
+  hierarchy.AccessAll(reqs, n, buf);
+}
+
+// Overlap reading and parsing on the stream thread with simulation here
+void handle_stream(char *buf) {
+  TraceStream stream;
+  if (!stream.Open(trace_path)) {
+    cerr << "Can't open trace " << trace_path << endl;
+    exit(1);
+  }
+  while (auto requests = stream.Next())
+    handle_requests(requests->data(), requests->size(), buf);
+  if (stream.Failed()) {
+    cerr << "Malformed trace " << trace_path << endl;
+    exit(1);
+  }
+}
 
-  l1 = new Cache();
+// Simulate the (sampled) shards in parallel, then report their sum through hierarchy
+void handle_shards() {
+  if (!sharded.Init(hierarchy_config, shards, sample_sets)) {
+    cerr << "--shards must be a power of two below the set count of each level" << endl;
+    exit(1);
+  }
+  if (!sharded.Inexact().empty())
+    cerr << "Warning: sharded results are approximate, " << sharded.Inexact() << endl;
+  auto start = chrono::steady_clock::now();
+  sharded.Run(requests, iter, threads);
+  simulate_seconds = seconds_since(start);
+  sharded.MergeStats(hierarchy);
+}
 
-  l2 = new Cache();
-  mem = new Memory();
+// L1 here and L2 on a second thread, then report the reconstructed stats through hierarchy
+void handle_pipeline() {
+  PipelinedHierarchy pipelined;
+  if (!pipelined.Init(hierarchy_config)) {
+    cerr << "Invalid cache config" << endl;
+    exit(1);
+  }
+  auto start = chrono::steady_clock::now();
+  pipelined.Run(requests, iter);
+  simulate_seconds = seconds_since(start);
+  pipelined.MergeStats(hierarchy);
+}
 
-  // Init L1 cache
-  l1->SetStats(stats);
-  l1->SetLower(l2);
-  l1->SetConfig(l1_config);
-  l1->SetLatency({L1_HIT_LATENCY, L1_BUS_LATENCY});
+// Feed a recorded L1 miss stream straight into L2
+void handle_misses() {
+  auto start = chrono::steady_clock::now();
+  replay_miss_stream(miss_header, miss_records, hierarchy);
+  simulate_seconds = seconds_since(start);
+}
 
-  // Init L2 cache
-  l2->SetStats(stats);
-  l2->SetLower(mem);
-  l2->SetConfig(l2_config);
-  l2->SetLatency({L2_HIT_LATENCY, L2_BUS_LATENCY});
+void finish_recording() {
+  StorageStats stats;
+  l1->GetStats(stats);
+  if (!miss_writer.Close(stats, hierarchy.GetStats())) {
+    cerr << "Failed writing " << record_path << endl;
+    exit(1);
+  }
+  cerr << "Recorded " << miss_writer.Size() << " L1 lower requests to " << record_path << endl;
+}
 
-  // Init memory
-  mem->SetStats(stats);
-  mem->SetLatency({MEM_HIT_LATENCY, MEM_BUS_LATENCY});
+void finish_tracing() {
+  if (!tracer.Finish()) {
+    cerr << "Failed writing " << (events_path.empty() ? "the event trace" : events_path) << endl;
+    exit(1);
+  }
+  if (verbose && !tracer.Decode(stderr)) {
+    cerr << "Malformed event trace" << endl;
+    exit(1);
+  }
+  if (!events_path.empty())
+    cerr << "Traced " << tracer.Size() << " events to " << events_path << endl;
 }
 
 void handle_trace() {
-  total_hit = 0;
-  total_time = 0;
-  total_request = 0;
-  char *buf = static_cast<char *>(malloc(sizeof(char) * l1_config.block_size));
-  while (iter--) {
-    ifstream fi;
-    fi.open(trace_path);
-    char op;
-    uint64_t addr;
-    int hit, time;
-    while (fi >> op >> hex >> addr) {
-      total_request++;
-      if (op == 'r') {
-        l1->HandleRequest(addr, 1, 1, buf, hit, time);
-      } else {
-        l1->HandleRequest(addr, 1, 0, buf, hit, time);
-      }
-      total_hit += hit;
-      total_time += time;
-      if (verbose) {
-        cerr << op << " " << hex << addr << ": " << hit << " " << time << "\n";
-      }
-    }
-    fi.close();
+  if (miss_input)
+    return handle_misses();
+  if (shards)
+    return handle_shards();
+  if (pipeline)
+    return handle_pipeline();
+  char *buf = tag_only ? nullptr : static_cast<char *>(malloc(sizeof(char) * hierarchy_config.levels[0].cache.block_size));
+  vector<TraceRequest> chunk(REPLAY_CHUNK_SIZE);
+  auto pass = [&]() {
+    if (binary_input) {
+      binary_trace.Rewind();
+      size_t n;
+      do {
+        for (n = 0; n < chunk.size() && binary_trace.Next(chunk[n]); n++);
+        handle_requests(chunk.data(), n, buf);
+      } while (n == chunk.size());
+    } else {
+      handle_requests(requests.data(), requests.size(), buf);
+    }
+  };
+  auto start = chrono::steady_clock::now();
+  if (stream_input) {
+    handle_stream(buf);
+  } else if (!extrapolate || verbose || !events_path.empty() || !record_path.empty()) {
+    // Every pass must be traced or recorded
+    for (int i = 0; i < iter; i++)
+      pass();
+  } else {
+    simulated_passes = hierarchy.RunPasses(iter, pass);
   }
+  simulate_seconds = seconds_since(start);
   free(buf);
 }
 
+void print_interval(const char *name, const SampleInterval &interval) {
+  if (isnan(interval.half_width))
+    printf("  %-16s:     %f +- n/a\n", name, interval.value);
+  else
+    printf("  %-16s:     %f +- %f\n", name, interval.value, interval.half_width);
+}
+
+// 95% confidence intervals of the estimates scaled up from the sampled sets
+void print_sampling() {
+  auto l1_stats = [](const Hierarchy &h) {
+    StorageStats stats;
+    h.L1()->GetStats(stats);
+    return stats;
+  };
+  auto l2_stats = [](const Hierarchy &h) {
+    StorageStats stats;
+    h.L2()->GetStats(stats);
+    return stats;
+  };
+  printf("Sampling stats:\n");
+  printf("  Sampled shards  :     %d/%d (%f of the sets)\n", sharded.Sampled(), sharded.Shards(),
+         (double) sharded.Sampled() / sharded.Shards());
+  print_interval("Total request", sharded.TotalInterval([](const Hierarchy &h) {
+    return (double) h.GetStats().request_num;
+  }));
+  print_interval("Total time", sharded.TotalInterval([](const Hierarchy &h) {
+    return (double) h.GetStats().time;
+  }));
+  print_interval("Miss rate", sharded.RatioInterval([](const Hierarchy &h) {
+    return (double) (h.GetStats().request_num - h.GetStats().hit_num);
+  }, [](const Hierarchy &h) {
+    return (double) h.GetStats().request_num;
+  }));
+  print_interval("L1 miss rate", sharded.RatioInterval([&](const Hierarchy &h) {
+    return (double) l1_stats(h).miss_num;
+  }, [&](const Hierarchy &h) {
+    return (double) l1_stats(h).access_counter;
+  }));
+  if (hierarchy.Levels() < 2)
+    return;
+  print_interval("L2 miss rate", sharded.RatioInterval([&](const Hierarchy &h) {
+    return (double) l2_stats(h).miss_num;
+  }, [&](const Hierarchy &h) {
+    return (double) l2_stats(h).access_counter;
+  }));
+}
+
+// Prefetched lines hit or evicted unused, and the demand misses on the
+// blocks prefetches evicted
+void print_prefetch(const StorageStats &stats) {
+  printf("  Useful prefetch :     %d\n", stats.useful_prefetch_num);
+  printf("  Useless prefetch:     %d\n", stats.useless_prefetch_num);
+  printf("  Polluting misses:     %d\n", stats.polluting_prefetch_num);
+}
+
+// A bypass is right unless its block missed again shortly after, a fill
+// in a full set unless the line was evicted without a hit
+void print_bypass(const StorageStats &stats) {
+  int predictions = stats.bypass_num + stats.keep_num;
+  int right = stats.bypass_num - stats.bypass_miss_num + stats.keep_num - stats.dead_num;
+  printf("  Bypass number   :     %d\n", stats.bypass_num);
+  printf("  Bypass accuracy :     %f\n", predictions ? (double) right / predictions : 0.0);
+}
+
+// What the core saw in the non-blocking model: throughput, the latency of
+// its requests and the memory traffic per cycle, plus how the MSHRs coped
+void print_timing_model(const StorageStats &mem_stats) {
+  auto &total = hierarchy.GetStats();
+  double cycles = max(total.cycles, 1);
+  printf("Non-blocking stats:\n");
+  printf("  Window          :     %d\n", window);
+  printf("  Cycles          :     %d\n", total.cycles);
+  printf("  Requests/cycle  :     %f\n", total.request_num / cycles);
+  printf("  Core latency    :     %f (cycles)\n", (double) total.time / total.request_num);
+  printf("  Mem bandwidth   :     %f (bytes/cycle)\n", mem_stats.byte_num / cycles);
+  for (int i = 0; i < hierarchy.Levels(); i++) {
+    StorageStats stats;
+    hierarchy.Level(i)->GetStats(stats);
+    printf("  L%d MSHRs        :     %d\n", i + 1, hierarchy_config.levels[i].cache.mshrs);
+    printf("  L%d MSHR merges  :     %d\n", i + 1, stats.merge_num);
+    printf("  L%d MSHR stalls  :     %d (cycles)\n", i + 1, stats.mshr_stall_time);
+  }
+}
+
+// Row buffer locality and the bandwidth it allowed: over the run in the
+// timing model, else over the time memory was busy with one request at a time
+void print_dram(const StorageStats &mem_stats) {
+  int bursts = max(mem_stats.byte_num / DRAM_BURST_SIZE, 1);
+  double cycles = window ? hierarchy.GetStats().cycles : mem_stats.access_time;
+  printf("DRAM stats:\n");
+  printf("  Row hits        :     %d\n", mem_stats.row_hit_num);
+  printf("  Row conflicts   :     %d\n", mem_stats.row_conflict_num);
+  printf("  Row hit rate    :     %f\n", (double) mem_stats.row_hit_num / bursts);
+  printf("  Conflict rate   :     %f\n", (double) mem_stats.row_conflict_num / bursts);
+  printf("  Bandwidth       :     %f (bytes/cycle)\n", cycles > 0 ? mem_stats.byte_num / cycles : 0.0);
+  printf("  Peak bandwidth  :     %f (bytes/cycle)\n", static_cast<Dram *>(mem)->PeakBandwidth());
+}
+
 void print_stats() {
-  StorageStats l1_stats;
-  StorageStats l2_stats;
   StorageStats mem_stats;
-  l1->GetStats(l1_stats);
-  l2->GetStats(l2_stats);
   mem->GetStats(mem_stats);
 
-  double l1_mr = (double)l1_stats.miss_num / l1_stats.access_counter;
-  double l2_mr = (double)l2_stats.miss_num / l2_stats.access_counter;
-
-  double amat = L1_BUS_LATENCY + L1_HIT_LATENCY + l1_mr * (L2_BUS_LATENCY + L2_HIT_LATENCY + l2_mr * MEM_HIT_LATENCY);
+  auto &total = hierarchy.GetStats();
 
   printf("Global stats:\n");
-  printf("  Total request   :     %d\n", total_request);
-  printf("  Total time      :     %d\n", total_time);
-  printf("  Miss number     :     %d\n", total_request - total_hit);
-  printf("  Miss rate       :     %f\n", (double)(total_request - total_hit) / total_request);
-  printf("  AMAT            :     %f (cycles)\n", amat);
-
-  printf("L1 Cache stats:\n");
-  printf("  Access counter  :     %d\n", l1_stats.access_counter);
-  printf("  Access time     :     %d\n", l1_stats.access_time);
-  printf("  Miss number     :     %d\n", l1_stats.miss_num);
-  printf("  Miss rate       :     %f\n", (double) l1_stats.miss_num / l1_stats.access_counter);
-  printf("  Replace number  :     %d\n", l1_stats.replace_num);
-  printf("  Prefetch number :     %d\n", l1_stats.prefetch_num);
-
-  printf("L2 Cache stats:\n");
-  printf("  Access counter  :     %d\n", l2_stats.access_counter);
-  printf("  Access time     :     %d\n", l2_stats.access_time);
-  printf("  Miss number     :     %d\n", l2_stats.miss_num);
-  printf("  Miss rate       :     %f\n", (double) l2_stats.miss_num / l2_stats.access_counter);
-  printf("  Replace number  :     %d\n", l2_stats.replace_num);
-  printf("  Prefetch number :     %d\n", l2_stats.prefetch_num);
+  printf("  Total request   :     %d\n", total.request_num);
+  printf("  Total time      :     %d\n", total.time);
+  printf("  Miss number     :     %d\n", total.request_num - total.hit_num);
+  printf("  Miss rate       :     %f\n", (double)(total.request_num - total.hit_num) / total.request_num);
+  printf("  AMAT            :     %f (cycles)\n", hierarchy.Amat());
+
+  for (int i = 0; i < hierarchy.Levels(); i++) {
+    StorageStats stats;
+    hierarchy.Level(i)->GetStats(stats);
+    auto &config = hierarchy_config.levels[i].cache;
+    printf("L%d Cache stats:\n", i + 1);
+    printf("  Access counter  :     %d\n", stats.access_counter);
+    printf("  Access time     :     %d\n", stats.access_time);
+    printf("  Miss number     :     %d\n", stats.miss_num);
+    printf("  Miss rate       :     %f\n", (double) stats.miss_num / stats.access_counter);
+    printf("  Replace number  :     %d\n", stats.replace_num);
+    printf("  Prefetch number :     %d\n", stats.prefetch_num);
+    if (config.prefetch > 0)
+      print_prefetch(stats);
+    if (config.bypass)
+      print_bypass(stats);
+  }
 
   printf("Memory stats:\n");
   printf("  Access counter  :     %d\n", mem_stats.access_counter);
   printf("  Access time     :     %d\n", mem_stats.access_time);
+  if (hierarchy_config.dram)
+    print_dram(mem_stats);
+
+  if (window)
+    print_timing_model(mem_stats);
+
+  if (sample_sets < 1)
+    print_sampling();
+
+  printf("Timing stats:\n");
+  printf("  Parse time      :     %f (s)\n", parse_seconds);
+  printf("  Simulate time   :     %f (s)\n", simulate_seconds);
+  if (simulated_passes && simulated_passes < iter)
+    printf("  Simulated passes:     %d of %d, the rest extrapolated\n", simulated_passes, iter);
+}
+
+// cache-simulator convert <text-trace> <binary-trace>
+int convert_main(int argc, char *argv[]) {
+  argparse::ArgumentParser parser("cache-simulator convert");
+
+  parser.add_argument("input")
+      .help("Path to text trace file");
+
+  parser.add_argument("output")
+      .help("Path to write binary trace");
+
+  try {
+    parser.parse_args(argc, argv);
+  }
+  catch (const runtime_error &err) {
+    cerr << err.what() << endl;
+    cerr << parser;
+    return 1;
+  }
+
+  auto input = parser.get<string>("input");
+  auto output = parser.get<string>("output");
+  MappedFile file;
+  if (!file.Open(input)) {
+    cerr << "Can't open trace " << input << endl;
+    return 1;
+  }
+  BinaryTraceWriter writer;
+  if (!writer.Open(output)) {
+    cerr << "Can't create " << output << endl;
+    return 1;
+  }
+  // Parse in line aligned pieces so the text trace never has to fit in memory
+  const char *p = file.Data(), *end = p + file.Size();
+  vector<TraceRequest> chunk;
+  uint64_t count = 0;
+  while (p < end) {
+    const char *chunk_end = next_line(p + min<size_t>(CONVERT_CHUNK_SIZE, end - p) - 1, end);
+    chunk.clear();
+    if (!parse_text_trace(p, chunk_end, chunk, best_hex_kernel())) {
+      cerr << "Malformed trace " << input << endl;
+      return 1;
+    }
+    for (auto &req: chunk)
+      writer.Append(req.addr, req.read);
+    count += chunk.size();
+    p = chunk_end;
+  }
+  if (!writer.Close()) {
+    cerr << "Failed writing " << output << endl;
+    return 1;
+  }
+  printf("Converted %llu requests to %s\n", (unsigned long long) count, output.c_str());
+  return 0;
+}
+
+// cache-simulator mrc <trace>
+int mrc_main(int argc, char *argv[]) {
+  argparse::ArgumentParser parser("cache-simulator mrc");
+
+  parser.add_argument("trace-path")
+      .help("Path to trace file");
+
+  parser.add_argument("--block-size")
+      .help("Block size in bytes")
+      .default_value(L1_BLOCK_SIZE)
+      .scan<'i', int>();
+
+  parser.add_argument("--assoc")
+      .help("Comma separated associativities, the fully associative curve is always reported")
+      .default_value(string("1,2,4,8,16"));
+
+  parser.add_argument("--min-size")
+      .help("Smallest cache size, e.g. 1K")
+      .default_value(string("1K"));
+
+  parser.add_argument("--max-size")
+      .help("Largest cache size, e.g. 8M")
+      .default_value(string("8M"));
+
+  parser.add_argument("--sample-rate")
+      .help("Fraction of blocks and sets to hash-sample, 1 for exact curves")
+      .default_value(1.0)
+      .scan<'g', double>();
+
+  parser.add_argument("--iter")
+      .help("Trace iteration count")
+      .default_value(1)
+      .scan<'i', int>();
+
+  parser.add_argument("--threads")
+      .help("Trace parser threads, 0 for one per hardware thread")
+      .default_value(0)
+      .scan<'i', int>();
+
+  try {
+    parser.parse_args(argc, argv);
+  }
+  catch (const runtime_error &err) {
+    cerr << err.what() << endl;
+    cerr << parser;
+    return 1;
+  }
+
+  MrcConfig mc;
+  mc.block_size = parser.get<int>("--block-size");
+  mc.min_size = parse_size(parser.get<string>("--min-size"));
+  mc.max_size = parse_size(parser.get<string>("--max-size"));
+  mc.sample_rate = parser.get<double>("--sample-rate");
+  stringstream assoc_list(parser.get<string>("--assoc"));
+  for (string assoc; getline(assoc_list, assoc, ',');)
+    mc.assoc.push_back(atoi(assoc.c_str()));
+  MissRatioCurve mrc;
+  if (!mrc.Init(mc)) {
+    cerr << "Invalid mrc config, sizes and associativities must be powers of two" << endl;
+    return 1;
+  }
+
+  auto path = parser.get<string>("trace-path");
+  vector<TraceRequest> trace;
+  if (!load_trace(path, trace, parser.get<int>("--threads"))) {
+    cerr << "Can't open trace " << path << endl;
+    return 1;
+  }
+  for (int i = parser.get<int>("--iter"); i > 0; i--) {
+    for (auto &req: trace)
+      mrc.Access(req.addr);
+  }
+
+  printf("LRU miss ratio curve: %llu accesses, %d byte blocks, write allocate",
+         (unsigned long long) mrc.Accesses(), mc.block_size);
+  if (mc.sample_rate < 1)
+    printf(", %g sampled", mc.sample_rate);
+  printf("\n  %-8s  %-9s", "Size", "full");
+  for (int assoc: mc.assoc)
+    printf("  %-9s", (to_string(assoc) + "-way").c_str());
+  printf("\n");
+  for (uint64_t size = mc.min_size; size <= mc.max_size; size *= 2) {
+    printf("  %-8s  %9f", format_size(size).c_str(), mrc.MissRatio(size, 0));
+    for (int assoc: mc.assoc) {
+      double ratio = mrc.MissRatio(size, assoc);
+      if (ratio < 0)
+        printf("  %9s", "-");
+      else
+        printf("  %9f", ratio);
+    }
+    printf("\n");
+  }
+  return 0;
+}
+
+// argv with the options moved ahead of the positional arguments, so they may
+// also follow arguments declared with remaining(). Options in value_options
+// take the next argument with them.
+static vector<string> options_first(int argc, char *argv[], const vector<string> &value_options) {
+  vector<string> options = {argv[0]}, positionals;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg.size() < 2 || arg[0] != '-') {
+      positionals.push_back(arg);
+    } else if (find(value_options.begin(), value_options.end(), arg) == value_options.end()) {
+      options.push_back(arg);
+    } else if (i + 1 < argc) {
+      options.push_back(arg);
+      options.push_back(argv[++i]);
+    } else {
+      // A trailing option without its value stays last
+      positionals.push_back(arg);
+    }
+  }
+  options.insert(options.end(), positionals.begin(), positionals.end());
+  return options;
+}
+
+// cache-simulator sweep <trace> [axis...]
+int sweep_main(int argc, char *argv[]) {
+  argparse::ArgumentParser parser("cache-simulator sweep");
+
+  parser.add_argument("trace-path")
+      .help("Path to trace file");
+
+  parser.add_argument("axes")
+      .help("Grid axes such as l1.size=16K,32K l2.replacement=lru,drrip, keys are levels, l<n>. followed by "
+            "size, assoc, block, replacement, prefetch, prefetcher, throttle, mct, bypass (0, 1 or a predictor), "
+            "write-through, write-allocate, mshrs, hit-latency or bus-latency, and memory. followed by type, "
+            "hit-latency, bus-latency or a DRAM parameter as in --config files")
+      .remaining();
+
+  parser.add_argument("--config")
+      .help("Hierarchy config file the points start from, see cache-simulator --help");
+
+  parser.add_argument("--list")
+      .help("File with one configuration per line as key=value settings, instead of a grid");
+
+  parser.add_argument("--optimized")
+      .help("Start from the optimized config")
+      .default_value(false)
+      .implicit_value(true);
+
+  parser.add_argument("--iter")
+      .help("Trace iteration count")
+      .default_value(10)
+      .scan<'i', int>();
+
+  parser.add_argument("--threads")
+      .help("Simulation and parser threads, 0 for one per hardware thread")
+      .default_value(0)
+      .scan<'i', int>();
+
+  parser.add_argument("--csv")
+      .help("Print the results as CSV")
+      .default_value(false)
+      .implicit_value(true);
+
+  try {
+    parser.parse_args(options_first(argc, argv, {"--list", "--config", "--iter", "--threads"}));
+  }
+  catch (const runtime_error &err) {
+    cerr << err.what() << endl;
+    cerr << parser;
+    return 1;
+  }
+
+  auto path = parser.get<string>("trace-path");
+  bool miss_input = is_miss_stream(path);
+  MissStreamHeader miss_header;
+  if (miss_input && !load_miss_stream_header(path, miss_header)) {
+    cerr << "Malformed miss stream " << path << endl;
+    return 1;
+  }
+  CacheConfig l1, l2;
+  preset_configs(parser.get<bool>("--optimized"), true, l1, l2);
+  auto base = two_level_config(l1, l2);
+  if (auto config = parser.present("--config")) {
+    if (!load_hierarchy_config(*config, base))
+      return 1;
+  }
+  if (miss_input)
+    base.levels[0].cache = miss_header.l1_config;
+  vector<SweepPoint> points;
+  vector<string> axes;
+  if (parser.is_used("axes"))
+    axes = parser.get<vector<string>>("axes");
+  if (auto list = parser.present("--list")) {
+    if (!axes.empty()) {
+      cerr << "Use either grid axes or --list" << endl;
+      return 1;
+    }
+    if (!load_sweep_list(*list, base, points))
+      return 1;
+  } else if (!expand_sweep_grid(base, axes, points)) {
+    return 1;
+  }
+  bool mshrs = false;
+  for (size_t i = 0; i < points.size(); i++) {
+    // The table reports L1 and L2
+    if (points[i].levels.size() < 2) {
+      cerr << "Point " << i << " has fewer than two cache levels" << endl;
+      return 1;
+    }
+    for (auto &level: points[i].levels)
+      mshrs |= level.cache.mshrs > 0;
+  }
+  if (mshrs)
+    cerr << "Sweep points run the serial model, their mshrs are ignored" << endl;
+
+  int threads = parser.get<int>("--threads");
+  vector<SweepResult> results;
+  double seconds;
+  if (miss_input) {
+    // L1 is baked into the stream, only L2 and below can vary
+    for (auto &point: points) {
+      if (!check_miss_stream_config(miss_header, point.levels[0].cache, point.levels[1].cache))
+        return 1;
+    }
+    MissStreamHeader header;
+    vector<PipelineRecord> records;
+    if (!load_miss_stream(path, header, records)) {
+      cerr << "Malformed miss stream " << path << endl;
+      return 1;
+    }
+    auto start = chrono::steady_clock::now();
+    run_sweep(header, records, points, threads, results);
+    seconds = seconds_since(start);
+  } else {
+    vector<TraceRequest> trace;
+    if (!load_trace(path, trace, threads)) {
+      cerr << "Can't open trace " << path << endl;
+      return 1;
+    }
+    auto start = chrono::steady_clock::now();
+    run_sweep(trace, parser.get<int>("--iter"), points, threads, results);
+    seconds = seconds_since(start);
+  }
+
+  bool csv = parser.get<bool>("--csv");
+  const char *header = csv ?
+      "id,l1_size,l1_assoc,l1_replacement,l1_prefetch,l1_prefetcher,l1_bypass,l2_size,l2_assoc,l2_replacement,"
+      "l2_prefetch,l2_prefetcher,l2_mct,l2_bypass,l1_miss_rate,l2_miss_rate,amat,total_time,seconds\n" :
+      "  %-4s %-7s %-5s %-10s %-3s %-10s %-13s %-7s %-5s %-10s %-3s %-10s %-3s %-13s  %-9s %-9s %-9s %-12s %s\n";
+  const char *row = csv ?
+      "%zu,%s,%d,%s,%d,%s,%s,%s,%d,%s,%d,%s,%d,%s,%f,%f,%f,%d,%f\n" :
+      "  %-4zu %-7s %-5d %-10s %-3d %-10s %-13s %-7s %-5d %-10s %-3d %-10s %-3d %-13s  %9f %9f %9f %12d %.3f\n";
+  printf(header, "id", "L1", "assoc", "repl", "pf", "prefetcher", "bypass", "L2", "assoc", "repl", "pf", "prefetcher",
+         "mct", "bypass", "L1 miss", "L2 miss", "AMAT", "total time", "seconds");
+  for (size_t i = 0; i < points.size(); i++) {
+    auto &l1 = points[i].levels[0].cache, &l2 = points[i].levels[1].cache;
+    auto &result = results[i];
+    if (!result.valid) {
+      cerr << "Invalid cache config for point " << i << endl;
+      continue;
+    }
+    printf(row, i, format_size(l1.size).c_str(), l1.associativity, l1.replacement.c_str(), l1.prefetch,
+           l1.prefetch > 0 ? l1.prefetcher.c_str() : "none", l1.bypass ? l1.bypass_predictor.c_str() : "none",
+           format_size(l2.size).c_str(), l2.associativity, l2.replacement.c_str(), l2.prefetch,
+           l2.prefetch > 0 ? l2.prefetcher.c_str() : "none", l2.mct, l2.bypass ? l2.bypass_predictor.c_str() : "none",
+           (double) result.l1.miss_num / result.l1.access_counter,
+           (double) result.l2.miss_num / result.l2.access_counter, result.amat, result.total.time, result.seconds);
+  }
+  fprintf(stderr, "Simulated %zu configurations in %f s\n", points.size(), seconds);
+  return 0;
+}
+
+// cache-simulator events <event-trace>
+int events_main(int argc, char *argv[]) {
+  argparse::ArgumentParser parser("cache-simulator events");
+
+  parser.add_argument("input")
+      .help("Path to an event trace written with --trace-events");
+
+  parser.add_argument("--level")
+      .help("Only print the events of this level, 1 for L1, 0 for all")
+      .default_value(0)
+      .scan<'i', int>();
+
+  parser.add_argument("--type")
+      .help("Only print events of this type: access, prefetch, evict, writeback or bypass");
+
+  parser.add_argument("--summary")
+      .help("Print event counts by level and type instead of the events")
+      .default_value(false)
+      .implicit_value(true);
+
+  try {
+    parser.parse_args(argc, argv);
+  }
+  catch (const runtime_error &err) {
+    cerr << err.what() << endl;
+    cerr << parser;
+    return 1;
+  }
+
+  auto input = parser.get<string>("input");
+  int type = -1;
+  if (auto name = parser.present("--type")) {
+    for (type = 0; type < kEventTypeNum && *name != event_type_name(type); type++);
+    if (type == kEventTypeNum) {
+      cerr << "Unknown event type " << *name << endl;
+      return 1;
+    }
+  }
+  FILE *in = fopen(input.c_str(), "rb");
+  if (!in) {
+    cerr << "Can't open event trace " << input << endl;
+    return 1;
+  }
+  bool ok = decode_events(in, stdout, parser.get<int>("--level"), type, parser.get<bool>("--summary"));
+  fclose(in);
+  if (!ok) {
+    cerr << "Malformed event trace " << input << endl;
+    return 1;
+  }
+  return 0;
 }
 
 int main(int argc, char *argv[]) {
+  if (argc > 1 && strcmp(argv[1], "convert") == 0)
+    return convert_main(argc - 1, argv + 1);
+  if (argc > 1 && strcmp(argv[1], "mrc") == 0)
+    return mrc_main(argc - 1, argv + 1);
+  if (argc > 1 && strcmp(argv[1], "sweep") == 0)
+    return sweep_main(argc - 1, argv + 1);
+  if (argc > 1 && strcmp(argv[1], "events") == 0)
+    return events_main(argc - 1, argv + 1);
   parse_args(argc, argv);
   init_cache();
+  load_requests();
   handle_trace();
+  if (!record_path.empty())
+    finish_recording();
+  if (verbose || !events_path.empty())
+    finish_tracing();
   print_stats();
   return 0;
 }
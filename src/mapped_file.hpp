@@ -0,0 +1,30 @@
+#ifndef CACHE_MAPPED_FILE_H_
+#define CACHE_MAPPED_FILE_H_
+
+#include <stddef.h>
+#include <string>
+#include "storage.hpp"
+
+using namespace std;
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+ public:
+  MappedFile() : data_(nullptr), size_(0) {}
+  ~MappedFile() { Close(); }
+
+  // Map path into memory, returns false if it can't be opened or mapped
+  bool Open(const string &path);
+
+  void Close();
+
+  const char *Data() const { return data_; }
+  size_t Size() const { return size_; }
+
+ private:
+  const char *data_;
+  size_t size_;
+  DISALLOW_COPY_AND_ASSIGN(MappedFile);
+};
+
+#endif //CACHE_MAPPED_FILE_H_
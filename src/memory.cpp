@@ -6,5 +6,6 @@ void Memory::HandleRequest(uint64_t addr, int bytes, int read,
   time = latency_.hit_latency + latency_.bus_latency;
   stats_.access_time += time;
   stats_.access_counter++;
+  stats_.byte_num += bytes;
 }
 
@@ -4,15 +4,19 @@
 #include <stdint.h>
 #include "storage.hpp"
 
+// Flat memory, every access takes hit_latency + bus_latency
 class Memory: public Storage {
  public:
   Memory() {}
-  ~Memory() {}
+  virtual ~Memory() {}
 
   // Main access process
   void HandleRequest(uint64_t addr, int bytes, int read,
                      char *content, int &hit, int &time, bool prefetch = false);
 
+  // Hash of the state that decides future latencies, see Cache::StateHash()
+  virtual uint64_t StateHash() const { return 0; }
+
  private:
   // Memory implement
 
@@ -0,0 +1,263 @@
+#include <string.h>
+#include "miss_stream.hpp"
+
+#define MISS_STREAM_FLUSH_SIZE (1 << 20)
+
+enum MissRecordFlag {
+  kMissRead = 1,
+  kMissPrefetch = 2,
+  kMissTimed = 4,
+  kMissCharged = 8,
+  kMissFull = 16,
+};
+
+enum MissConfigFlag {
+  kConfigWriteThrough = 1,
+  kConfigWriteAllocate = 2,
+  kConfigBypass = 4,
+  kConfigThrottle = 8,
+};
+
+static uint8_t *put_varint(uint8_t *p, uint64_t x) {
+  while (x >= 0x80) {
+    *p++ = x | 0x80;
+    x >>= 7;
+  }
+  *p++ = x;
+  return p;
+}
+
+static const uint8_t *get_varint(const uint8_t *p, const uint8_t *end, uint64_t &x) {
+  x = 0;
+  for (int shift = 0; p < end && shift < 64; shift += 7) {
+    uint8_t byte = *p++;
+    x |= (uint64_t) (byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      return p;
+  }
+  return nullptr;
+}
+
+static void put_stats(uint8_t *p, const StorageStats &stats) {
+  put_u64(p, stats.access_counter);
+  put_u64(p + 8, stats.miss_num);
+  put_u64(p + 16, stats.access_time);
+  put_u64(p + 24, stats.replace_num);
+  put_u64(p + 32, stats.fetch_num);
+  put_u64(p + 40, stats.prefetch_num);
+}
+
+static void put_name(uint8_t *p, const string &name) {
+  memcpy(p, name.data(), min<size_t>(name.size(), MISS_STREAM_NAME_SIZE - 1));
+}
+
+static string get_name(const uint8_t *p) {
+  return string(reinterpret_cast<const char *>(p), strnlen(reinterpret_cast<const char *>(p), MISS_STREAM_NAME_SIZE - 1));
+}
+
+static void get_stats(const uint8_t *p, StorageStats &stats) {
+  stats.access_counter = get_u64(p);
+  stats.miss_num = get_u64(p + 8);
+  stats.access_time = get_u64(p + 16);
+  stats.replace_num = get_u64(p + 24);
+  stats.fetch_num = get_u64(p + 32);
+  stats.prefetch_num = get_u64(p + 40);
+  // Not recorded, the timing model needs a live L1
+  stats.merge_num = stats.mshr_stall_time = 0;
+  // Memory only
+  stats.byte_num = stats.row_hit_num = stats.row_conflict_num = 0;
+}
+
+bool is_miss_stream(const string &path) {
+  char magic[8];
+  FILE *f = fopen(path.c_str(), "rb");
+  if (!f)
+    return false;
+  bool ok = fread(magic, 1, 8, f) == 8 && memcmp(magic, MISS_STREAM_MAGIC, 7) == 0;
+  fclose(f);
+  return ok;
+}
+
+MissStreamWriter::~MissStreamWriter() {
+  if (file_)
+    fclose(file_);
+}
+
+bool MissStreamWriter::Open(const string &path, Cache *upper, Storage *lower, const CacheConfig &l1_config) {
+  file_ = fopen(path.c_str(), "wb");
+  if (!file_)
+    return false;
+  upper_ = upper;
+  lower_ = lower;
+  l1_config_ = l1_config;
+  prev_ = 0;
+  record_num_ = 0;
+  timed_time_ = charged_time_ = 0;
+  buf_.clear();
+  // Placeholder header, rewritten by Close() once the stats are known
+  uint8_t header[MISS_STREAM_HEADER_SIZE] = {0};
+  return fwrite(header, 1, sizeof(header), file_) == sizeof(header);
+}
+
+void MissStreamWriter::HandleRequest(uint64_t addr, int bytes, int read,
+                                     char *content, int &hit, int &time, bool prefetch) {
+  PipelineRecord rec = {addr, bytes, (uint8_t) read, prefetch, upper_->LowerTimed(), upper_->LowerCharged()};
+  lower_->HandleRequest(addr, bytes, read, content, hit, time, prefetch);
+  if (rec.timed)
+    timed_time_ += time;
+  if (rec.charged)
+    charged_time_ += time;
+
+  uint8_t record[MISS_STREAM_MAX_RECORD], *p = record;
+  bool full = bytes == l1_config_.block_size;
+  *p++ = (rec.read ? kMissRead : 0) | (rec.prefetch ? kMissPrefetch : 0) | (rec.timed ? kMissTimed : 0) |
+         (rec.charged ? kMissCharged : 0) | (full ? kMissFull : 0);
+  uint64_t delta = addr - prev_;
+  p = put_varint(p, (delta << 1) ^ (uint64_t) ((int64_t) delta >> 63));
+  if (!full)
+    p = put_varint(p, bytes);
+  buf_.insert(buf_.end(), record, p);
+  prev_ = addr;
+  record_num_++;
+  if (buf_.size() >= MISS_STREAM_FLUSH_SIZE)
+    Flush();
+}
+
+bool MissStreamWriter::Flush() {
+  bool ok = fwrite(buf_.data(), 1, buf_.size(), file_) == buf_.size();
+  buf_.clear();
+  return ok;
+}
+
+bool MissStreamWriter::Close(const StorageStats &l1, const HierarchyStats &total) {
+  if (!file_)
+    return false;
+  bool ok = Flush();
+  MissStreamHeader header;
+  header.version = MISS_STREAM_VERSION;
+  header.record_num = record_num_;
+  header.l1_config = l1_config_;
+  header.l1 = l1;
+  header.l1.access_time -= charged_time_;
+  header.total = total;
+  header.total.time -= timed_time_;
+
+  uint8_t buf[MISS_STREAM_HEADER_SIZE] = {0};
+  memcpy(buf, MISS_STREAM_MAGIC, 7);
+  put_u32(buf + 8, header.version);
+  auto &cc = header.l1_config;
+  put_u32(buf + 12, cc.block_size);
+  put_u64(buf + 16, header.record_num);
+  put_stats(buf + 24, header.l1);
+  put_u64(buf + 72, header.total.request_num);
+  put_u64(buf + 80, header.total.hit_num);
+  put_u64(buf + 88, header.total.time);
+  put_u32(buf + 96, cc.size);
+  put_u32(buf + 100, cc.associativity);
+  put_u32(buf + 104, cc.prefetch);
+  put_u32(buf + 108, cc.mct);
+  put_u32(buf + 112, (cc.write_through ? kConfigWriteThrough : 0) | (cc.write_allocate ? kConfigWriteAllocate : 0) |
+                     (cc.bypass ? kConfigBypass : 0) | (cc.prefetch_throttle ? kConfigThrottle : 0));
+  put_name(buf + 116, cc.replacement);
+  put_name(buf + 132, cc.bypass_predictor);
+  put_u64(buf + 148, header.l1.bypass_num);
+  put_u64(buf + 156, header.l1.bypass_miss_num);
+  put_u64(buf + 164, header.l1.keep_num);
+  put_u64(buf + 172, header.l1.dead_num);
+  put_name(buf + 180, cc.prefetcher);
+  put_u64(buf + 196, header.l1.useful_prefetch_num);
+  put_u64(buf + 204, header.l1.useless_prefetch_num);
+  put_u64(buf + 212, header.l1.polluting_prefetch_num);
+  ok = ok && fseek(file_, 0, SEEK_SET) == 0;
+  ok = ok && fwrite(buf, 1, sizeof(buf), file_) == sizeof(buf);
+  ok = fclose(file_) == 0 && ok;
+  file_ = nullptr;
+  return ok;
+}
+
+static bool parse_header(const uint8_t *data, size_t size, MissStreamHeader &header) {
+  if (size < MISS_STREAM_HEADER_SIZE || memcmp(data, MISS_STREAM_MAGIC, 7) != 0)
+    return false;
+  auto &cc = header.l1_config;
+  header.version = get_u32(data + 8);
+  cc.block_size = get_u32(data + 12);
+  header.record_num = get_u64(data + 16);
+  get_stats(data + 24, header.l1);
+  header.total.request_num = get_u64(data + 72);
+  header.total.hit_num = get_u64(data + 80);
+  header.total.time = get_u64(data + 88);
+  header.total.cycles = 0;
+  cc.size = get_u32(data + 96);
+  cc.associativity = get_u32(data + 100);
+  cc.set_num = 0;
+  cc.prefetch = get_u32(data + 104);
+  cc.mct = get_u32(data + 108);
+  uint32_t flags = get_u32(data + 112);
+  cc.write_through = flags & kConfigWriteThrough;
+  cc.write_allocate = flags & kConfigWriteAllocate;
+  cc.bypass = flags & kConfigBypass;
+  cc.replacement = get_name(data + 116);
+  cc.bypass_predictor = get_name(data + 132);
+  header.l1.bypass_num = get_u64(data + 148);
+  header.l1.bypass_miss_num = get_u64(data + 156);
+  header.l1.keep_num = get_u64(data + 164);
+  header.l1.dead_num = get_u64(data + 172);
+  cc.prefetcher = get_name(data + 180);
+  cc.prefetch_throttle = flags & kConfigThrottle;
+  header.l1.useful_prefetch_num = get_u64(data + 196);
+  header.l1.useless_prefetch_num = get_u64(data + 204);
+  header.l1.polluting_prefetch_num = get_u64(data + 212);
+  cc.tag_only = true; // Records carry no content
+  cc.mshrs = 0;
+  return header.version == MISS_STREAM_VERSION && cc.block_size > 0;
+}
+
+bool load_miss_stream_header(const string &path, MissStreamHeader &header) {
+  uint8_t buf[MISS_STREAM_HEADER_SIZE];
+  FILE *f = fopen(path.c_str(), "rb");
+  if (!f)
+    return false;
+  size_t size = fread(buf, 1, sizeof(buf), f);
+  fclose(f);
+  return parse_header(buf, size, header);
+}
+
+bool load_miss_stream(const string &path, MissStreamHeader &header, vector<PipelineRecord> &records) {
+  MappedFile file;
+  if (!file.Open(path))
+    return false;
+  auto data = reinterpret_cast<const uint8_t *>(file.Data());
+  auto end = data + file.Size();
+  if (!parse_header(data, file.Size(), header))
+    return false;
+
+  records.clear();
+  records.reserve(min<uint64_t>(header.record_num, file.Size()));
+  uint64_t prev = 0;
+  for (auto p = data + MISS_STREAM_HEADER_SIZE; p < end;) {
+    uint8_t flags = *p++;
+    uint64_t zz, bytes = header.l1_config.block_size;
+    p = get_varint(p, end, zz);
+    if (p && !(flags & kMissFull))
+      p = get_varint(p, end, bytes);
+    if (!p || bytes == 0 || bytes > (uint64_t) header.l1_config.block_size)
+      return false;
+    prev += (zz >> 1) ^ (0 - (zz & 1));
+    records.push_back({prev, (int32_t) bytes, (uint8_t) (flags & kMissRead), (uint8_t) !!(flags & kMissPrefetch),
+                       (uint8_t) !!(flags & kMissTimed), (uint8_t) !!(flags & kMissCharged)});
+  }
+  return records.size() == header.record_num;
+}
+
+void replay_miss_stream(const MissStreamHeader &header, const vector<PipelineRecord> &records,
+                        Hierarchy &hierarchy) {
+  int timed_time = 0, charged_time = 0;
+  for (auto &rec: records)
+    replay_record(hierarchy.L2(), rec, timed_time, charged_time);
+  auto l1 = header.l1;
+  l1.access_time += charged_time;
+  hierarchy.L1()->SetStats(l1);
+  auto total = header.total;
+  total.time += timed_time;
+  hierarchy.SetStats(total);
+}
@@ -0,0 +1,83 @@
+#ifndef CACHE_MISS_STREAM_H_
+#define CACHE_MISS_STREAM_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "binary_trace.hpp"
+#include "hierarchy.hpp"
+#include "pipeline.hpp"
+
+using namespace std;
+
+// Miss stream layout, the requests L1 sent to L2, all integers little-endian:
+//   header   magic, version, L1 block size, record count, then the L1
+//            StorageStats, the HierarchyStats without any lower level time,
+//            the rest of the L1 config, and the L1 bypass and prefetch
+//            usefulness stats
+//   records  a flag byte [0:3][full:1][charged:1][timed:1][prefetch:1][read:1],
+//            the zigzag LEB128 address delta from the previous record, and
+//            the LEB128 byte count unless full (a whole L1 block)
+// Replaying it into an L2 gives the same stats as simulating the whole
+// trace, for any L2 and memory config and with the recorded L1.
+#define MISS_STREAM_MAGIC "CSMISS"
+#define MISS_STREAM_VERSION 3
+#define MISS_STREAM_HEADER_SIZE 220
+#define MISS_STREAM_NAME_SIZE 16 // Bytes of a zero padded policy name in the header
+#define MISS_STREAM_MAX_RECORD 21
+
+typedef struct MissStreamHeader_ {
+  uint32_t version;
+  uint64_t record_num;
+  CacheConfig l1_config; // Replaying needs an L2 block at least as large as its block
+  StorageStats l1; // access_time without the time of the lower requests
+  HierarchyStats total; // time without the time of the lower requests
+} MissStreamHeader;
+
+// Returns true if path starts with the miss stream magic
+bool is_miss_stream(const string &path);
+
+// Sits between L1 and the real L2, forwarding every request and recording it
+class MissStreamWriter : public Storage {
+ public:
+  MissStreamWriter() : file_(nullptr) {}
+  ~MissStreamWriter();
+
+  bool Open(const string &path, Cache *upper, Storage *lower, const CacheConfig &l1_config);
+
+  void HandleRequest(uint64_t addr, int bytes, int read,
+                     char *content, int &hit, int &time, bool prefetch = false);
+
+  // Writes the last records and the header from the final stats
+  bool Close(const StorageStats &l1, const HierarchyStats &total);
+
+  uint64_t Size() const { return record_num_; }
+
+ private:
+  bool Flush();
+
+  FILE *file_;
+  Cache *upper_;
+  Storage *lower_;
+  CacheConfig l1_config_;
+  uint64_t prev_;
+  uint64_t record_num_;
+  int timed_time_; // Lower time the stats include, subtracted for the header
+  int charged_time_;
+  vector<uint8_t> buf_;
+  DISALLOW_COPY_AND_ASSIGN(MissStreamWriter);
+};
+
+// Read only the header, false if it is malformed
+bool load_miss_stream_header(const string &path, MissStreamHeader &header);
+
+// Decode a whole miss stream, false if it is malformed
+bool load_miss_stream(const string &path, MissStreamHeader &header, vector<PipelineRecord> &records);
+
+// Replay records into the L2 of hierarchy and fill in L1 and the totals
+// from header, as if the original trace had been simulated
+void replay_miss_stream(const MissStreamHeader &header, const vector<PipelineRecord> &records,
+                        Hierarchy &hierarchy);
+
+#endif //CACHE_MISS_STREAM_H_
@@ -0,0 +1,76 @@
+#include "pipeline.hpp"
+
+PipelineLink::PipelineLink(Cache *upper, Storage *lower)
+    : upper_(upper), lower_(lower), buffers_(PIPELINE_BUFFERS), full_(PIPELINE_BUFFERS + 1),
+      free_(PIPELINE_BUFFERS), current_(nullptr), timed_time_(0), charged_time_(0) {
+  for (auto &buffer: buffers_) {
+    buffer.reserve(PIPELINE_BATCH);
+    free_.Push(&buffer);
+  }
+}
+
+void PipelineLink::HandleRequest(uint64_t addr, int bytes, int read,
+                                 char * /*content*/, int &hit, int &time, bool prefetch) {
+  if (!current_)
+    free_.Pop(current_);
+  current_->push_back({addr, bytes, (uint8_t) read, prefetch, upper_->LowerTimed(), upper_->LowerCharged()});
+  if (current_->size() == PIPELINE_BATCH)
+    Flush();
+  hit = 0;
+  time = 0;
+}
+
+void PipelineLink::Flush() {
+  full_.Push(current_);
+  current_ = nullptr;
+}
+
+void PipelineLink::Close() {
+  if (current_)
+    Flush();
+  full_.Push(nullptr);
+}
+
+void PipelineLink::Drain() {
+  vector<PipelineRecord> *batch;
+  for (full_.Pop(batch); batch; full_.Pop(batch)) {
+    for (auto &rec: *batch)
+      replay_record(lower_, rec, timed_time_, charged_time_);
+    batch->clear();
+    free_.Push(batch);
+  }
+}
+
+bool PipelinedHierarchy::Init(const HierarchyConfig &config) {
+  auto tag_only = config;
+  for (auto &level: tag_only.levels)
+    level.cache.tag_only = true;
+  if (tag_only.levels.size() < 2 || !hierarchy_.Init(tag_only))
+    return false;
+  link_.reset(new PipelineLink(hierarchy_.L1(), hierarchy_.L2()));
+  hierarchy_.L1()->SetLower(link_.get());
+  return true;
+}
+
+void PipelinedHierarchy::Run(const vector<TraceRequest> &requests, int iter) {
+  thread lower([this] { link_->Drain(); });
+  hierarchy_.Run(requests, iter, false); // L2 is still draining at pass boundaries
+  link_->Close();
+  lower.join();
+}
+
+void PipelinedHierarchy::MergeStats(Hierarchy &hierarchy) const {
+  StorageStats stats;
+  hierarchy_.L1()->GetStats(stats);
+  stats.access_time += link_->ChargedTime();
+  hierarchy.L1()->SetStats(stats);
+  for (int i = 1; i < hierarchy_.Levels(); i++) {
+    hierarchy_.Level(i)->GetStats(stats);
+    hierarchy.Level(i)->SetStats(stats);
+  }
+  hierarchy_.Mem()->GetStats(stats);
+  hierarchy.Mem()->SetStats(stats);
+  auto total = hierarchy_.GetStats();
+  total.time += link_->TimedTime();
+  hierarchy.SetStats(total);
+}
@@ -0,0 +1,98 @@
+#ifndef CACHE_PIPELINE_H_
+#define CACHE_PIPELINE_H_
+
+#include <stdint.h>
+#include <thread>
+#include <vector>
+#include "hierarchy.hpp"
+#include "spsc_ring.hpp"
+
+using namespace std;
+
+#define PIPELINE_BATCH 4096 // Lower requests per buffer
+#define PIPELINE_BUFFERS 8  // Buffers in flight between the two threads
+
+// Lower request recorded by a PipelineLink
+typedef struct PipelineRecord_ {
+  uint64_t addr;
+  int32_t bytes;
+  uint8_t read;
+  uint8_t prefetch;
+  uint8_t timed; // Cache::LowerTimed() of the issuing cache
+  uint8_t charged; // Cache::LowerCharged()
+} PipelineRecord;
+
+// Issue rec to lower and add its time to the sums its flags select
+inline void replay_record(Storage *lower, const PipelineRecord &rec, int &timed_time, int &charged_time) {
+  int hit, time;
+  lower->HandleRequest(rec.addr, rec.bytes, rec.read, nullptr, hit, time, rec.prefetch);
+  if (rec.timed)
+    timed_time += time;
+  if (rec.charged)
+    charged_time += time;
+}
+
+// Stands in for the next level on the upper cache's thread. Requests are
+// answered at once as zero time misses and queued in batches for Drain(),
+// which replays them into the real lower level on another thread and sums
+// the lower times the upper cache would have added, to patch the totals
+// afterwards. Tag only, there is no content to pass back.
+class PipelineLink : public Storage {
+ public:
+  PipelineLink(Cache *upper, Storage *lower);
+  ~PipelineLink() {}
+
+  void HandleRequest(uint64_t addr, int bytes, int read,
+                     char *content, int &hit, int &time, bool prefetch = false);
+
+  // Producer side: flush the last batch and signal the end
+  void Close();
+
+  // Consumer side: replay until Close()
+  void Drain();
+
+  // Lower time of timed requests and of charged requests, valid after Drain()
+  int TimedTime() const { return timed_time_; }
+  int ChargedTime() const { return charged_time_; }
+
+ private:
+  void Flush();
+
+  Cache *upper_;
+  Storage *lower_;
+  vector<vector<PipelineRecord>> buffers_;
+  SpscRing<vector<PipelineRecord> *> full_; // Upper -> lower thread, nullptr ends
+  SpscRing<vector<PipelineRecord> *> free_; // Lower -> upper thread
+  vector<PipelineRecord> *current_;
+  int timed_time_;
+  int charged_time_;
+  DISALLOW_COPY_AND_ASSIGN(PipelineLink);
+};
+
+// Hierarchy with L1 on the calling thread and the levels below plus memory
+// on a second thread, connected by a PipelineLink. Stats match the serial
+// Hierarchy.
+class PipelinedHierarchy {
+ public:
+  PipelinedHierarchy() {}
+  ~PipelinedHierarchy() {}
+
+  // False for an invalid config or one of a single level, runs tag only
+  bool Init(const HierarchyConfig &config);
+
+  bool Init(const CacheConfig &l1_config, const CacheConfig &l2_config) {
+    return Init(two_level_config(l1_config, l2_config));
+  }
+
+  void Run(const vector<TraceRequest> &requests, int iter);
+
+  // Copy the reconstructed stats into a hierarchy of the same configs
+  void MergeStats(Hierarchy &hierarchy) const;
+
+ private:
+  Hierarchy hierarchy_;
+  unique_ptr<PipelineLink> link_;
+  DISALLOW_COPY_AND_ASSIGN(PipelinedHierarchy);
+};
+
+#endif //CACHE_PIPELINE_H_
@@ -0,0 +1,168 @@
+#include <cstdlib>
+#include "prefetch.hpp"
+
+void Prefetcher::Reset(int degree, bool throttle) {
+  max_degree_ = degree_ = degree;
+  throttle_ = throttle;
+  useful_ = useless_ = 0;
+}
+
+void Prefetcher::OnFeedback(bool useful) {
+  if (!throttle_)
+    return;
+  (useful ? useful_ : useless_)++;
+  if (useful_ + useless_ < PREFETCH_THROTTLE_INTERVAL)
+    return;
+  if (useful_ * 4 > PREFETCH_THROTTLE_INTERVAL * 3)
+    degree_ = min(degree_ + 1, max_degree_);
+  else if (useful_ * 5 < PREFETCH_THROTTLE_INTERVAL * 2)
+    degree_ = max(degree_ - 1, 1);
+  useful_ = useless_ = 0;
+}
+
+uint64_t Prefetcher::StateHash() const {
+  return state_hash_step(state_hash_step(degree_, useful_), useless_);
+}
+
+void Prefetcher::AppendRun(uint64_t block, int64_t step, vector<uint64_t> &blocks) const {
+  for (int64_t k = 1; k <= degree_; k++) {
+    // Stop short of wrapping around either end of the address space
+    if (step < 0 ? block < (uint64_t) (-step * k) : ~block < (uint64_t) (step * k))
+      break;
+    blocks.push_back(block + step * k);
+  }
+}
+
+void StridePrefetcher::Reset(int degree, bool throttle) {
+  Prefetcher::Reset(degree, throttle);
+  entries_.assign(PREFETCH_STRIDE_ENTRIES, {~0ULL, 0, 0, 0});
+}
+
+void StridePrefetcher::Trigger(uint64_t block, bool /*miss*/, vector<uint64_t> &blocks) {
+  uint64_t region = block / PREFETCH_REGION_BLOCKS;
+  auto &entry = entries_[region % PREFETCH_STRIDE_ENTRIES];
+  if (entry.region != region) {
+    entry = {region, block, 0, 0};
+    return;
+  }
+  int64_t stride = block - entry.last;
+  entry.confidence = stride && stride == entry.stride ? min(entry.confidence + 1, 3) : 0;
+  entry.stride = stride;
+  entry.last = block;
+  if (entry.confidence >= 1)
+    AppendRun(block, stride, blocks);
+}
+
+uint64_t StridePrefetcher::StateHash() const {
+  uint64_t hash = Prefetcher::StateHash();
+  for (auto &entry: entries_) {
+    hash = state_hash_step(hash, entry.region);
+    hash = state_hash_step(hash, entry.last);
+    hash = state_hash_step(hash, entry.stride);
+    hash = state_hash_step(hash, entry.confidence);
+  }
+  return hash;
+}
+
+void StreamPrefetcher::Reset(int degree, bool throttle) {
+  Prefetcher::Reset(degree, throttle);
+  streams_.assign(PREFETCH_STREAMS, {0, 0, 0, 0});
+  triggers_ = 0;
+}
+
+void StreamPrefetcher::Trigger(uint64_t block, bool /*miss*/, vector<uint64_t> &blocks) {
+  triggers_++;
+  Stream *lru = &streams_[0];
+  for (auto &stream: streams_) {
+    int64_t delta = block - stream.head;
+    if (stream.stamp && delta && llabs(delta) <= PREFETCH_STREAM_WINDOW) {
+      int direction = delta > 0 ? 1 : -1;
+      stream.confidence = direction == stream.direction ? min(stream.confidence + 1, 3) : 0;
+      stream.direction = direction;
+      stream.head = block;
+      stream.stamp = triggers_;
+      if (stream.confidence >= 1)
+        AppendRun(block, direction, blocks);
+      return;
+    }
+    if (stream.stamp < lru->stamp)
+      lru = &stream;
+  }
+  *lru = {block, 0, 0, triggers_};
+}
+
+uint64_t StreamPrefetcher::StateHash() const {
+  // Stamps only matter relative to each other, so they are hashed by age
+  uint64_t hash = Prefetcher::StateHash();
+  for (auto &stream: streams_) {
+    hash = state_hash_step(hash, stream.head);
+    hash = state_hash_step(hash, stream.direction);
+    hash = state_hash_step(hash, stream.confidence);
+    hash = state_hash_step(hash, stream.stamp ? triggers_ - stream.stamp : ~0ULL);
+  }
+  return hash;
+}
+
+void RegionPrefetcher::Reset(int degree, bool throttle) {
+  Prefetcher::Reset(degree, throttle);
+  regions_.assign(PREFETCH_REGIONS, {~0ULL, 0, 0, 0});
+  patterns_.assign(PREFETCH_REGION_BLOCKS, 0);
+  triggers_ = 0;
+}
+
+void RegionPrefetcher::Trigger(uint64_t block, bool /*miss*/, vector<uint64_t> &blocks) {
+  triggers_++;
+  uint64_t region = block / PREFETCH_REGION_BLOCKS;
+  int offset = block % PREFETCH_REGION_BLOCKS;
+  Region *lru = &regions_[0];
+  for (auto &r: regions_) {
+    if (r.region == region) {
+      r.footprint |= 1ULL << offset;
+      r.stamp = triggers_;
+      return;
+    }
+    if (r.stamp < lru->stamp)
+      lru = &r;
+  }
+  if (lru->stamp)
+    patterns_[lru->trigger] = lru->footprint;
+  *lru = {region, offset, 1ULL << offset, triggers_};
+  // The stored footprint, nearest blocks first
+  uint64_t pattern = patterns_[offset] & ~(1ULL << offset);
+  uint64_t base = region * PREFETCH_REGION_BLOCKS;
+  for (int distance = 1; distance < PREFETCH_REGION_BLOCKS && (int) blocks.size() < degree_; distance++) {
+    for (int o: {offset + distance, offset - distance}) {
+      if (o >= 0 && o < PREFETCH_REGION_BLOCKS && (pattern >> o & 1) && (int) blocks.size() < degree_)
+        blocks.push_back(base + o);
+    }
+  }
+}
+
+uint64_t RegionPrefetcher::StateHash() const {
+  uint64_t hash = Prefetcher::StateHash();
+  for (auto &r: regions_) {
+    hash = state_hash_step(hash, r.region);
+    hash = state_hash_step(hash, r.trigger);
+    hash = state_hash_step(hash, r.footprint);
+    hash = state_hash_step(hash, r.stamp ? triggers_ - r.stamp : ~0ULL);
+  }
+  for (auto pattern: patterns_)
+    hash = state_hash_step(hash, pattern);
+  return hash;
+}
+
+Prefetcher *create_prefetcher(const string &name) {
+  if (name == "next-line")
+    return new NextLinePrefetcher();
+  if (name == "stride")
+    return new StridePrefetcher();
+  if (name == "stream")
+    return new StreamPrefetcher();
+  if (name == "region")
+    return new RegionPrefetcher();
+  return nullptr;
+}
+
+const char *prefetcher_names() {
+  return "next-line, stride, stream, region";
+}
@@ -0,0 +1,137 @@
+#ifndef CACHE_PREFETCH_H_
+#define CACHE_PREFETCH_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "replacement.hpp"
+
+using namespace std;
+
+#define PREFETCH_THROTTLE_INTERVAL 256 // Prefetched lines judged per throttle decision
+#define PREFETCH_STRIDE_ENTRIES 64 // Regions tracked by the stride prefetcher
+#define PREFETCH_STREAMS 16 // Streams tracked by the stream prefetcher
+#define PREFETCH_STREAM_WINDOW 16 // Blocks from the head of a stream that still advance it
+#define PREFETCH_REGIONS 32 // Regions recording a footprint in the region prefetcher
+#define PREFETCH_REGION_BLOCKS 64 // Blocks per region of the stride and region prefetchers
+
+// Picks the blocks a cache prefetches. Block numbers are addresses without
+// the offset bits. A prefetcher is triggered by every demand miss and every
+// first demand hit on a prefetched line, which marks a stream the prefetches
+// have caught up with. With throttling on, the degree follows the accuracy
+// of the lines prefetched since the last change, after feedback directed
+// prefetching: above 3/4 it grows back towards the configured degree, below
+// 2/5 it shrinks down to one.
+class Prefetcher {
+ public:
+  Prefetcher() : max_degree_(0), degree_(0), throttle_(false), useful_(0), useless_(0) {}
+  virtual ~Prefetcher() {}
+
+  // Start over with up to degree blocks per trigger, called from Cache::SetConfig
+  virtual void Reset(int degree, bool throttle);
+
+  // Append the blocks to prefetch after a demand miss on block, or a demand
+  // hit on a prefetched line if miss is false, to blocks
+  virtual void Trigger(uint64_t block, bool miss, vector<uint64_t> &blocks) = 0;
+
+  // A prefetched line was hit by demand if useful, else evicted unused
+  void OnFeedback(bool useful);
+
+  int Degree() const { return degree_; }
+
+  // Hash of all state that decides future prefetches
+  virtual uint64_t StateHash() const;
+
+ protected:
+  // Append block + k * step for k from 1 to the degree, short of wrapping
+  void AppendRun(uint64_t block, int64_t step, vector<uint64_t> &blocks) const;
+
+  int max_degree_;
+  int degree_;
+  bool throttle_;
+  int useful_, useless_; // Feedback since the last throttle decision
+};
+
+// The original prefetcher: the next degree blocks after each demand miss
+class NextLinePrefetcher final : public Prefetcher {
+ public:
+  void Trigger(uint64_t block, bool miss, vector<uint64_t> &blocks) {
+    if (miss)
+      AppendRun(block, 1, blocks);
+  }
+};
+
+// Stride detector over the address deltas within each region, since traces
+// carry no PCs to tell the access streams apart. A delta seen twice in a row
+// prefetches degree strides ahead.
+class StridePrefetcher final : public Prefetcher {
+ public:
+  void Reset(int degree, bool throttle);
+  void Trigger(uint64_t block, bool miss, vector<uint64_t> &blocks);
+  uint64_t StateHash() const;
+
+ private:
+  typedef struct Entry_ {
+    uint64_t region;
+    uint64_t last; // Last block
+    int64_t stride;
+    int confidence;
+  } Entry;
+
+  vector<Entry> entries_; // Direct mapped by region
+};
+
+// Tracks up to PREFETCH_STREAMS ascending or descending streams. A trigger
+// within PREFETCH_STREAM_WINDOW blocks of a stream's head advances it, the
+// second advance in the same direction confirms it and from then on each
+// advance prefetches the degree blocks beyond the head. Other triggers start
+// a stream in place of the least recently advanced one.
+class StreamPrefetcher final : public Prefetcher {
+ public:
+  void Reset(int degree, bool throttle);
+  void Trigger(uint64_t block, bool miss, vector<uint64_t> &blocks);
+  uint64_t StateHash() const;
+
+ private:
+  typedef struct Stream_ {
+    uint64_t head;
+    int direction; // 1, -1, or 0 before the first advance
+    int confidence;
+    uint64_t stamp; // Trigger count at the last advance
+  } Stream;
+
+  vector<Stream> streams_;
+  uint64_t triggers_;
+};
+
+// Spatial footprints after SMS: each of PREFETCH_REGIONS active regions
+// collects a bitmap of the blocks triggered in it. When a region drops out
+// of the active set its footprint is stored under the offset of the block
+// that started it, and the next region started at that offset prefetches
+// the footprint's blocks nearest that block first, degree of them.
+class RegionPrefetcher final : public Prefetcher {
+ public:
+  void Reset(int degree, bool throttle);
+  void Trigger(uint64_t block, bool miss, vector<uint64_t> &blocks);
+  uint64_t StateHash() const;
+
+ private:
+  typedef struct Region_ {
+    uint64_t region;
+    int trigger; // Offset of the block that started it
+    uint64_t footprint;
+    uint64_t stamp;
+  } Region;
+
+  vector<Region> regions_;
+  vector<uint64_t> patterns_; // Footprint by trigger offset
+  uint64_t triggers_;
+};
+
+// Prefetcher by name, nullptr for an unknown name
+Prefetcher *create_prefetcher(const string &name);
+
+// Comma separated list of the names accepted above
+const char *prefetcher_names();
+
+#endif //CACHE_PREFETCH_H_
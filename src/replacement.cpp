@@ -0,0 +1,27 @@
+#include "replacement.hpp"
+
+ReplacementPolicy *create_replacement_policy(const string &name) {
+  if (name == "lru")
+    return new LruPolicy();
+  if (name == "plru")
+    return new PlruPolicy();
+  if (name == "tree-plru")
+    return new TreePlruPolicy();
+  if (name == "srrip")
+    return new RripPolicy(RripPolicy::kStatic);
+  if (name == "brrip")
+    return new RripPolicy(RripPolicy::kBimodal);
+  if (name == "drrip")
+    return new RripPolicy(RripPolicy::kDynamic);
+  if (name == "lfu")
+    return new LfuPolicy();
+  if (name == "fifo")
+    return new FifoPolicy();
+  if (name == "random")
+    return new RandomPolicy();
+  return nullptr;
+}
+
+const char *replacement_policy_names() {
+  return "lru, plru, tree-plru, srrip, brrip, drrip, lfu, fifo, random";
+}
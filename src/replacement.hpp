@@ -0,0 +1,359 @@
+#ifndef CACHE_REPLACEMENT_H_
+#define CACHE_REPLACEMENT_H_
+
+#include <stdint.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "aligned_allocator.hpp"
+#include "state_hash.hpp"
+
+using namespace std;
+
+// Replacement policy with per set state. Cache only asks for a victim once
+// every line of the set is valid, free lines are filled lowest index first.
+// The concrete policies are final so the specialized cache engines call
+// them without virtual dispatch.
+class ReplacementPolicy {
+ public:
+  ReplacementPolicy() : set_num_(0), assoc_(0) {}
+  virtual ~ReplacementPolicy() {}
+
+  // Size the per set state, called from Cache::SetConfig
+  virtual void Reset(int set_num, int associativity) {
+    set_num_ = set_num;
+    assoc_ = associativity;
+  }
+
+  // [in] now: demand access counter of the cache, prefetches reuse the current value
+  virtual void OnHit(uint64_t set_idx, int line_idx, uint64_t now) = 0;
+
+  // count hits in a row on one line, the last at now. One hit has the same
+  // effect as many for every policy that doesn't count them.
+  virtual void OnHits(uint64_t set_idx, int line_idx, uint64_t now, uint64_t count) { OnHit(set_idx, line_idx, now); }
+
+  // A missing block was placed in line_idx
+  virtual void OnFill(uint64_t set_idx, int line_idx, uint64_t now) = 0;
+
+  // Line to evict from a full set
+  virtual int Victim(uint64_t set_idx) = 0;
+
+  // The lines of a set in an order that, along with the line states hashed
+  // in it, decides future victims whichever line holds which block. LRU,
+  // LFU and FIFO sort the lines by the keys they compare, which is only safe
+  // while each touch gets a fresh key: lines touched at the same now tie and
+  // fall back to comparing indices. Otherwise the lines stay in place.
+  // [in] unique_now: now differs between any two touches, i.e. no prefetches reach the cache
+  virtual void CanonicalOrder(uint64_t set_idx, bool unique_now, int *lines) const {
+    for (int i = 0; i < assoc_; i++)
+      lines[i] = i;
+  }
+
+  // Hash of the per set state with the lines in canonical order, e.g. LRU
+  // hashes the recency ranks of the lines but not their stamps
+  virtual uint64_t SetStateHash(uint64_t set_idx, const int *lines) const = 0;
+
+  // Hash of the state shared by all sets
+  virtual uint64_t SharedStateHash() const { return 0; }
+
+ protected:
+  size_t Index(uint64_t set_idx, int line_idx) const { return set_idx * assoc_ + line_idx; }
+
+  // Lines of the set by ascending key, ties by line index like the victim searches
+  template <class Keys> void SortLines(const Keys &keys, uint64_t set_idx, bool sort, int *lines) const {
+    for (int i = 0; i < assoc_; i++)
+      lines[i] = i;
+    auto base = &keys[Index(set_idx, 0)];
+    if (sort)
+      stable_sort(lines, lines + assoc_, [base](int a, int b) { return base[a] < base[b]; });
+  }
+
+  // Hash of the ranks of the keys in line order, all that comparing them reveals
+  template <class Keys> uint64_t HashRanks(const Keys &keys, uint64_t set_idx, const int *lines) const {
+    auto base = &keys[Index(set_idx, 0)];
+    uint64_t hash = 0;
+    for (int i = 0; i < assoc_; i++) {
+      int rank = 0;
+      for (int j = 0; j < assoc_; j++)
+        rank += base[j] < base[lines[i]];
+      hash = state_hash_step(hash, rank);
+    }
+    return hash;
+  }
+
+  template <class Values> uint64_t HashLines(const Values &values, uint64_t set_idx, const int *lines) const {
+    uint64_t hash = 0;
+    for (int i = 0; i < assoc_; i++)
+      hash = state_hash_step(hash, values[Index(set_idx, lines[i])]);
+    return hash;
+  }
+
+  int set_num_;
+  int assoc_;
+};
+
+// Least recently used, ties go to the lowest line
+class LruPolicy final : public ReplacementPolicy {
+ public:
+  void Reset(int set_num, int associativity) {
+    ReplacementPolicy::Reset(set_num, associativity);
+    stamps_.assign((size_t) set_num * associativity, 0);
+  }
+  void OnHit(uint64_t set_idx, int line_idx, uint64_t now) { stamps_[Index(set_idx, line_idx)] = now; }
+  void OnFill(uint64_t set_idx, int line_idx, uint64_t now) { stamps_[Index(set_idx, line_idx)] = now; }
+  int Victim(uint64_t set_idx) {
+    auto stamps = &stamps_[Index(set_idx, 0)];
+    int victim = 0;
+    for (int i = 1; i < assoc_; i++) {
+      if (stamps[i] < stamps[victim])
+        victim = i;
+    }
+    return victim;
+  }
+  void CanonicalOrder(uint64_t set_idx, bool unique_now, int *lines) const {
+    SortLines(stamps_, set_idx, unique_now, lines);
+  }
+  uint64_t SetStateHash(uint64_t set_idx, const int *lines) const { return HashRanks(stamps_, set_idx, lines); }
+
+ private:
+  AlignedVector<uint64_t> stamps_; // Counter of the last touch, 64-bit so it never wraps
+};
+
+// The original "plru": the tree bits only advance along the victim path on
+// each replacement and ignore hits, so it cycles through the ways
+class PlruPolicy final : public ReplacementPolicy {
+ public:
+  void Reset(int set_num, int associativity) {
+    ReplacementPolicy::Reset(set_num, associativity);
+    levels_ = __builtin_ctz(associativity);
+    bits_.assign((size_t) set_num * associativity, 0);
+  }
+  void OnHit(uint64_t set_idx, int line_idx, uint64_t now) {}
+  void OnFill(uint64_t set_idx, int line_idx, uint64_t now) {}
+  int Victim(uint64_t set_idx) {
+    auto bits = &bits_[Index(set_idx, 0)];
+    int victim = 0, j = 0;
+    for (int i = 0; i < levels_; i++) {
+      int bit = bits[j];
+      victim = (victim << 1) | bit;
+      bits[j] = !bit;
+      j = j * 2 + 1 + bit;
+    }
+    return victim;
+  }
+  uint64_t SetStateHash(uint64_t set_idx, const int *lines) const { return HashLines(bits_, set_idx, lines); }
+
+ private:
+  int levels_;
+  vector<uint8_t> bits_; // associativity - 1 tree nodes per set
+};
+
+// Tree pseudo-LRU, every hit and fill points the path away from the line
+class TreePlruPolicy final : public ReplacementPolicy {
+ public:
+  void Reset(int set_num, int associativity) {
+    ReplacementPolicy::Reset(set_num, associativity);
+    levels_ = __builtin_ctz(associativity);
+    bits_.assign((size_t) set_num * associativity, 0);
+  }
+  void OnHit(uint64_t set_idx, int line_idx, uint64_t now) { Touch(set_idx, line_idx); }
+  void OnFill(uint64_t set_idx, int line_idx, uint64_t now) { Touch(set_idx, line_idx); }
+  int Victim(uint64_t set_idx) {
+    auto bits = &bits_[Index(set_idx, 0)];
+    int victim = 0, j = 0;
+    for (int i = 0; i < levels_; i++) {
+      int bit = bits[j];
+      victim = (victim << 1) | bit;
+      j = j * 2 + 1 + bit;
+    }
+    return victim;
+  }
+  uint64_t SetStateHash(uint64_t set_idx, const int *lines) const { return HashLines(bits_, set_idx, lines); }
+
+ private:
+  void Touch(uint64_t set_idx, int line_idx) {
+    auto bits = &bits_[Index(set_idx, 0)];
+    int j = 0;
+    for (int i = levels_ - 1; i >= 0; i--) {
+      int bit = line_idx >> i & 1;
+      bits[j] = !bit;
+      j = j * 2 + 1 + bit;
+    }
+  }
+
+  int levels_;
+  vector<uint8_t> bits_;
+};
+
+#define RRIP_MAX_RRPV 3 // 2-bit re-reference prediction values
+#define BRRIP_LONG_INTERVAL 32 // BRRIP inserts at long distance once per interval
+#define DRRIP_LEADER_INTERVAL 32 // One SRRIP and one BRRIP leader set per interval
+#define DRRIP_PSEL_MAX 1023
+
+// Re-reference interval prediction (Jaleel et al., ISCA 2010). Hits predict
+// near re-reference, the victim is the first line at distant re-reference.
+//   srrip  inserts at long distance
+//   brrip  inserts at distant, and at long once every BRRIP_LONG_INTERVAL fills
+//   drrip  duels SRRIP and BRRIP leader sets and lets the others follow the winner
+class RripPolicy final : public ReplacementPolicy {
+ public:
+  enum Mode { kStatic, kBimodal, kDynamic };
+
+  explicit RripPolicy(Mode mode) : mode_(mode) {}
+
+  void Reset(int set_num, int associativity) {
+    ReplacementPolicy::Reset(set_num, associativity);
+    rrpv_.assign((size_t) set_num * associativity, RRIP_MAX_RRPV);
+    fills_ = 0;
+    psel_ = (DRRIP_PSEL_MAX + 1) / 2;
+  }
+  void OnHit(uint64_t set_idx, int line_idx, uint64_t now) { rrpv_[Index(set_idx, line_idx)] = 0; }
+  void OnFill(uint64_t set_idx, int line_idx, uint64_t now) {
+    bool bimodal = mode_ == kBimodal;
+    if (mode_ == kDynamic) {
+      // A fill is a miss, leader misses move PSEL towards the other policy
+      int leader = set_idx % DRRIP_LEADER_INTERVAL;
+      if (leader == 0) {
+        psel_ += psel_ < DRRIP_PSEL_MAX;
+      } else if (leader == 1) {
+        psel_ -= psel_ > 0;
+        bimodal = true;
+      } else {
+        bimodal = psel_ > DRRIP_PSEL_MAX / 2;
+      }
+    }
+    int rrpv = RRIP_MAX_RRPV - 1;
+    if (bimodal && ++fills_ % BRRIP_LONG_INTERVAL)
+      rrpv = RRIP_MAX_RRPV;
+    rrpv_[Index(set_idx, line_idx)] = rrpv;
+  }
+  int Victim(uint64_t set_idx) {
+    auto rrpv = &rrpv_[Index(set_idx, 0)];
+    // Ageing every line until one reaches the maximum is one step
+    int oldest = 0;
+    for (int i = 0; i < assoc_; i++)
+      oldest = max<int>(oldest, rrpv[i]);
+    int age = RRIP_MAX_RRPV - oldest;
+    int victim = -1;
+    for (int i = 0; i < assoc_; i++) {
+      rrpv[i] += age;
+      if (victim < 0 && rrpv[i] == RRIP_MAX_RRPV)
+        victim = i;
+    }
+    return victim;
+  }
+  uint64_t SetStateHash(uint64_t set_idx, const int *lines) const { return HashLines(rrpv_, set_idx, lines); }
+  uint64_t SharedStateHash() const { return state_hash_step(fills_ % BRRIP_LONG_INTERVAL, psel_); }
+
+ private:
+  Mode mode_;
+  vector<uint8_t> rrpv_;
+  uint64_t fills_;
+  int psel_;
+};
+
+// Least frequently used, ties go to the least recently used line
+class LfuPolicy final : public ReplacementPolicy {
+ public:
+  void Reset(int set_num, int associativity) {
+    ReplacementPolicy::Reset(set_num, associativity);
+    counts_.assign((size_t) set_num * associativity, 0);
+    stamps_.assign((size_t) set_num * associativity, 0);
+  }
+  void OnHit(uint64_t set_idx, int line_idx, uint64_t now) {
+    auto idx = Index(set_idx, line_idx);
+    counts_[idx] += counts_[idx] != UINT32_MAX;
+    stamps_[idx] = now;
+  }
+  void OnHits(uint64_t set_idx, int line_idx, uint64_t now, uint64_t count) {
+    auto idx = Index(set_idx, line_idx);
+    counts_[idx] = (uint32_t) min<uint64_t>(counts_[idx] + count, UINT32_MAX);
+    stamps_[idx] = now;
+  }
+  void OnFill(uint64_t set_idx, int line_idx, uint64_t now) {
+    auto idx = Index(set_idx, line_idx);
+    counts_[idx] = 1;
+    stamps_[idx] = now;
+  }
+  int Victim(uint64_t set_idx) {
+    auto base = Index(set_idx, 0);
+    int victim = 0;
+    for (int i = 1; i < assoc_; i++) {
+      if (counts_[base + i] < counts_[base + victim] ||
+          (counts_[base + i] == counts_[base + victim] && stamps_[base + i] < stamps_[base + victim]))
+        victim = i;
+    }
+    return victim;
+  }
+  // Counts change the order as they grow, so the stamp order is what is canonical
+  void CanonicalOrder(uint64_t set_idx, bool unique_now, int *lines) const {
+    SortLines(stamps_, set_idx, unique_now, lines);
+  }
+  uint64_t SetStateHash(uint64_t set_idx, const int *lines) const {
+    return state_hash_step(HashLines(counts_, set_idx, lines), HashRanks(stamps_, set_idx, lines));
+  }
+
+ private:
+  vector<uint32_t> counts_;
+  vector<uint64_t> stamps_;
+};
+
+// First in first out, hits don't matter
+class FifoPolicy final : public ReplacementPolicy {
+ public:
+  void Reset(int set_num, int associativity) {
+    ReplacementPolicy::Reset(set_num, associativity);
+    order_.assign((size_t) set_num * associativity, 0);
+    fills_ = 0;
+  }
+  void OnHit(uint64_t set_idx, int line_idx, uint64_t now) {}
+  void OnFill(uint64_t set_idx, int line_idx, uint64_t now) { order_[Index(set_idx, line_idx)] = ++fills_; }
+  int Victim(uint64_t set_idx) {
+    auto order = &order_[Index(set_idx, 0)];
+    int victim = 0;
+    for (int i = 1; i < assoc_; i++) {
+      if (order[i] < order[victim])
+        victim = i;
+    }
+    return victim;
+  }
+  // Every fill takes a fresh order, whether or not prefetches share now
+  void CanonicalOrder(uint64_t set_idx, bool unique_now, int *lines) const {
+    SortLines(order_, set_idx, true, lines);
+  }
+  uint64_t SetStateHash(uint64_t set_idx, const int *lines) const { return HashRanks(order_, set_idx, lines); }
+
+ private:
+  vector<uint64_t> order_;
+  uint64_t fills_;
+};
+
+// Uniformly random victim from a fixed seed xorshift, so runs are repeatable
+class RandomPolicy final : public ReplacementPolicy {
+ public:
+  void Reset(int set_num, int associativity) {
+    ReplacementPolicy::Reset(set_num, associativity);
+    state_ = 0x9e3779b97f4a7c15ULL;
+  }
+  void OnHit(uint64_t set_idx, int line_idx, uint64_t now) {}
+  void OnFill(uint64_t set_idx, int line_idx, uint64_t now) {}
+  int Victim(uint64_t set_idx) {
+    state_ ^= state_ << 13;
+    state_ ^= state_ >> 7;
+    state_ ^= state_ << 17;
+    return state_ % assoc_;
+  }
+  uint64_t SetStateHash(uint64_t set_idx, const int *lines) const { return 0; }
+  uint64_t SharedStateHash() const { return state_; }
+
+ private:
+  uint64_t state_;
+};
+
+// Policy for a --l1-replacement/--l2-replacement name, nullptr if unknown
+ReplacementPolicy *create_replacement_policy(const string &name);
+
+// Comma separated list of the accepted names
+const char *replacement_policy_names();
+
+#endif //CACHE_REPLACEMENT_H_
@@ -0,0 +1,245 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "thread_pool.hpp"
+#include "shard.hpp"
+
+static void add_stats(StorageStats &sum, const StorageStats &stats) {
+  sum.access_counter += stats.access_counter;
+  sum.miss_num += stats.miss_num;
+  sum.access_time += stats.access_time;
+  sum.replace_num += stats.replace_num;
+  sum.fetch_num += stats.fetch_num;
+  sum.prefetch_num += stats.prefetch_num;
+  sum.bypass_num += stats.bypass_num;
+  sum.bypass_miss_num += stats.bypass_miss_num;
+  sum.keep_num += stats.keep_num;
+  sum.dead_num += stats.dead_num;
+  sum.useful_prefetch_num += stats.useful_prefetch_num;
+  sum.useless_prefetch_num += stats.useless_prefetch_num;
+  sum.polluting_prefetch_num += stats.polluting_prefetch_num;
+  sum.merge_num += stats.merge_num;
+  sum.mshr_stall_time += stats.mshr_stall_time;
+  sum.byte_num += stats.byte_num;
+  sum.row_hit_num += stats.row_hit_num;
+  sum.row_conflict_num += stats.row_conflict_num;
+}
+
+static void scale_stats(StorageStats &stats, double scale) {
+  stats.access_counter = (int) llround(stats.access_counter * scale);
+  stats.miss_num = (int) llround(stats.miss_num * scale);
+  stats.access_time = (int) llround(stats.access_time * scale);
+  stats.replace_num = (int) llround(stats.replace_num * scale);
+  stats.fetch_num = (int) llround(stats.fetch_num * scale);
+  stats.prefetch_num = (int) llround(stats.prefetch_num * scale);
+  stats.bypass_num = (int) llround(stats.bypass_num * scale);
+  stats.bypass_miss_num = (int) llround(stats.bypass_miss_num * scale);
+  stats.keep_num = (int) llround(stats.keep_num * scale);
+  stats.dead_num = (int) llround(stats.dead_num * scale);
+  stats.useful_prefetch_num = (int) llround(stats.useful_prefetch_num * scale);
+  stats.useless_prefetch_num = (int) llround(stats.useless_prefetch_num * scale);
+  stats.polluting_prefetch_num = (int) llround(stats.polluting_prefetch_num * scale);
+  stats.merge_num = (int) llround(stats.merge_num * scale);
+  stats.mshr_stall_time = (int) llround(stats.mshr_stall_time * scale);
+  stats.byte_num = (int) llround(stats.byte_num * scale);
+  stats.row_hit_num = (int) llround(stats.row_hit_num * scale);
+  stats.row_conflict_num = (int) llround(stats.row_conflict_num * scale);
+}
+
+// splitmix64 finalizer
+static uint64_t mix64(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+// Two sided 95% Student t quantiles for 1..30 degrees of freedom
+static const double T_QUANTILE_95[] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+
+static double t_quantile_95(int df) {
+  return df <= 30 ? T_QUANTILE_95[df - 1] : 1.96;
+}
+
+// Address bits [lo, hi) are set index bits at every level, false if a config is invalid
+static bool shard_bit_range(const HierarchyConfig &config, int &lo, int &hi) {
+  lo = 0, hi = 64;
+  for (auto &level: config.levels) {
+    auto cc = &level.cache;
+    if (cc->block_size <= 0 || cc->associativity <= 0 || cc->size < cc->block_size * cc->associativity)
+      return false;
+    int block_bits = __builtin_ctz(cc->block_size);
+    int set_bits = __builtin_ctz(cc->size / (cc->block_size * cc->associativity));
+    lo = max(lo, block_bits);
+    hi = min(hi, block_bits + set_bits);
+  }
+  return true;
+}
+
+int max_shards(const HierarchyConfig &config) {
+  int lo, hi;
+  if (!shard_bit_range(config, lo, hi) || lo + 1 >= hi)
+    return 0;
+  return 1 << (hi - lo - 1);
+}
+
+bool ShardedHierarchy::Init(const HierarchyConfig &config, int shards, double sample_rate) {
+  if (shards <= 0 || shards & (shards - 1) || !(sample_rate > 0 && sample_rate <= 1))
+    return false;
+  shards_ = shards;
+  inexact_.clear();
+  for (auto &level: config.levels) {
+    auto cc = &level.cache;
+    if (!inexact_.empty())
+      continue;
+    if (cc->prefetch > 0)
+      inexact_ = "prefetching crosses sets";
+    else if (cc->replacement == "random" || cc->replacement == "brrip" || cc->replacement == "drrip")
+      inexact_ = cc->replacement + " replacement shares state across sets";
+    else if (cc->bypass && cc->bypass_predictor != "mct")
+      inexact_ = cc->bypass_predictor + " bypass shares state across sets";
+  }
+  if (inexact_.empty() && config.dram)
+    inexact_ = "DRAM rows see the shard addresses";
+  // Shard bits must be set index bits of every level, leaving each shard
+  // cache at least the two sets Cache::SetConfig accepts
+  int lo, hi;
+  if (!shard_bit_range(config, lo, hi))
+    return false;
+  int shard_bits = __builtin_ctz(shards);
+  if (lo + shard_bits >= hi)
+    return false;
+  shard_lo_ = lo;
+
+  // Sample the shards with the smallest hashes, which spreads them over the address space
+  vector<int> order(shards);
+  for (int i = 0; i < shards; i++)
+    order[i] = i;
+  sort(order.begin(), order.end(), [](int a, int b) { return mix64(a) < mix64(b); });
+  int sampled = max(1, (int) lround(sample_rate * shards));
+  slots_.assign(shards, -1);
+  for (int i = 0; i < sampled; i++)
+    slots_[order[i]] = 0;
+
+  hierarchies_.clear();
+  auto shard_config = config;
+  for (auto &level: shard_config.levels) {
+    level.cache.size /= shards;
+    level.cache.tag_only = true;
+  }
+  for (int i = 0; i < shards; i++) {
+    if (slots_[i] < 0)
+      continue;
+    slots_[i] = (int) hierarchies_.size();
+    hierarchies_.emplace_back(new Hierarchy());
+    if (!hierarchies_.back()->Init(shard_config))
+      return false;
+  }
+  return true;
+}
+
+void ShardedHierarchy::Run(const vector<TraceRequest> &requests, int iter, int threads) {
+  // Split the stream, each shard keeps the original order of its requests
+  int shard_bits = __builtin_ctz(shards_);
+  uint64_t low_mask = (1ULL << shard_lo_) - 1;
+  vector<vector<TraceRequest>> streams(hierarchies_.size());
+  for (auto &req: requests) {
+    int slot = slots_[req.addr >> shard_lo_ & (shards_ - 1)];
+    if (slot < 0)
+      continue;
+    auto addr = (req.addr >> (shard_lo_ + shard_bits) << shard_lo_) | (req.addr & low_mask);
+    streams[slot].push_back({addr, req.read});
+  }
+  ThreadPool pool(min(threads > 0 ? threads : hardware_threads(), Sampled()));
+  pool.ParallelFor(hierarchies_.size(), [&](size_t i) {
+    hierarchies_[i]->Run(streams[i], iter);
+  });
+}
+
+void ShardedHierarchy::MergeStats(Hierarchy &hierarchy) const {
+  StorageStats mem, stats;
+  vector<StorageStats> levels(hierarchy.Levels());
+  HierarchyStats total;
+  for (auto &level: levels)
+    memset(&level, 0, sizeof(level));
+  memset(&mem, 0, sizeof(mem));
+  memset(&total, 0, sizeof(total));
+  for (auto &shard: hierarchies_) {
+    for (int i = 0; i < shard->Levels(); i++) {
+      shard->Level(i)->GetStats(stats);
+      add_stats(levels[i], stats);
+    }
+    shard->Mem()->GetStats(stats);
+    add_stats(mem, stats);
+    total.request_num += shard->GetStats().request_num;
+    total.hit_num += shard->GetStats().hit_num;
+    total.time += shard->GetStats().time;
+  }
+  if (Sampled() < shards_) {
+    double scale = (double) shards_ / Sampled();
+    for (auto &level: levels)
+      scale_stats(level, scale);
+    scale_stats(mem, scale);
+    total.request_num = (int) llround(total.request_num * scale);
+    total.hit_num = (int) llround(total.hit_num * scale);
+    total.time = (int) llround(total.time * scale);
+  }
+  for (int i = 0; i < hierarchy.Levels(); i++)
+    hierarchy.Level(i)->SetStats(levels[i]);
+  hierarchy.Mem()->SetStats(mem);
+  hierarchy.SetStats(total);
+}
+
+// Ratio and total estimators of simple random sampling without replacement,
+// each shard being one cluster of sets
+SampleInterval ShardedHierarchy::RatioInterval(const function<double(const Hierarchy &)> &num,
+                                               const function<double(const Hierarchy &)> &den) const {
+  int n = Sampled();
+  double num_sum = 0, den_sum = 0;
+  for (auto &shard: hierarchies_) {
+    num_sum += num(*shard);
+    den_sum += den(*shard);
+  }
+  SampleInterval interval = {den_sum ? num_sum / den_sum : 0, 0};
+  if (n == shards_ || !den_sum)
+    return interval;
+  if (n == 1) {
+    interval.half_width = NAN;
+    return interval;
+  }
+  double residual = 0;
+  for (auto &shard: hierarchies_) {
+    double r = num(*shard) - interval.value * den(*shard);
+    residual += r * r;
+  }
+  double den_mean = den_sum / n;
+  double variance = (1 - (double) n / shards_) * residual / (n - 1) / n / (den_mean * den_mean);
+  interval.half_width = t_quantile_95(n - 1) * sqrt(variance);
+  return interval;
+}
+
+SampleInterval ShardedHierarchy::TotalInterval(const function<double(const Hierarchy &)> &value) const {
+  int n = Sampled();
+  double sum = 0;
+  for (auto &shard: hierarchies_)
+    sum += value(*shard);
+  SampleInterval interval = {sum * shards_ / n, 0};
+  if (n == shards_)
+    return interval;
+  if (n == 1) {
+    interval.half_width = NAN;
+    return interval;
+  }
+  double mean = sum / n, spread = 0;
+  for (auto &shard: hierarchies_) {
+    double d = value(*shard) - mean;
+    spread += d * d;
+  }
+  double variance = (double) shards_ * shards_ * (1 - (double) n / shards_) * spread / (n - 1) / n;
+  interval.half_width = t_quantile_95(n - 1) * sqrt(variance);
+  return interval;
+}
@@ -0,0 +1,85 @@
+#ifndef CACHE_SHARD_H_
+#define CACHE_SHARD_H_
+
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "hierarchy.hpp"
+
+using namespace std;
+
+// Estimate from a set sample
+typedef struct SampleInterval_ {
+  double value;
+  double half_width; // Of the 95% confidence interval, 0 if every shard ran, NaN from one shard
+} SampleInterval;
+
+// Largest shard count Init accepts for this config, 0 if it is invalid.
+// Each shard cache keeps at least the two sets Cache::SetConfig accepts, so
+// the default 64 set L1 allows at most 32 shards.
+int max_shards(const HierarchyConfig &config);
+
+inline int max_shards(const CacheConfig &l1_config, const CacheConfig &l2_config) {
+  return max_shards(two_level_config(l1_config, l2_config));
+}
+
+// Runs one hierarchy as independent shards of its sets on a thread pool.
+// A block only ever meets blocks of its own set, so the k address bits just
+// above the largest block offset, which are set index bits at every level,
+// pick the shard. They are dropped from the address, which makes each shard
+// a hierarchy of 1/2^k the size whose sets line up with the original ones.
+// Per set state, misses, writebacks and latencies are then exactly those of
+// the serial run. Prefetching crosses sets, and random/BRRIP/DRRIP keep
+// state shared by all sets, so those results are approximate.
+//
+// With a sample rate below 1 only that fraction of the shards, picked by
+// hash, is built and simulated. Requests of the other shards are dropped
+// while splitting the trace, before any level sees them, and the merged
+// stats are scaled up by shards / sampled shards.
+class ShardedHierarchy {
+ public:
+  ShardedHierarchy() {}
+  ~ShardedHierarchy() {}
+
+  // False if the config is invalid or shards, a power of two, isn't below each level's set count
+  bool Init(const HierarchyConfig &config, int shards, double sample_rate = 1);
+
+  bool Init(const CacheConfig &l1_config, const CacheConfig &l2_config, int shards, double sample_rate = 1) {
+    return Init(two_level_config(l1_config, l2_config), shards, sample_rate);
+  }
+
+  // Why sharding isn't exact for these configs, empty if it is
+  const string &Inexact() const { return inexact_; }
+
+  // Simulate iter passes of the trace with threads workers
+  void Run(const vector<TraceRequest> &requests, int iter, int threads);
+
+  // Sum of the shard stats, scaled up if sampled, into a hierarchy of the full configs
+  void MergeStats(Hierarchy &hierarchy) const;
+
+  int Shards() const { return shards_; }
+  int Sampled() const { return (int) hierarchies_.size(); }
+
+  // Ratio of two shard stats summed over the sample, e.g. a miss rate.
+  // The interval assumes the sampled shards are a random draw, but they are
+  // the same smallest-hash shards on every run and nested across rates, and
+  // with a few shards of a few rare events, such as mostly compulsory L2
+  // misses, the spread between them understates the error.
+  SampleInterval RatioInterval(const function<double(const Hierarchy &)> &num,
+                               const function<double(const Hierarchy &)> &den) const;
+
+  // Total of a shard stat over all shards estimated from the sample
+  SampleInterval TotalInterval(const function<double(const Hierarchy &)> &value) const;
+
+ private:
+  int shards_;
+  int shard_lo_; // Lowest address bit of the shard index
+  vector<int> slots_; // Index into hierarchies_ of each shard, -1 if not sampled
+  vector<unique_ptr<Hierarchy>> hierarchies_;
+  string inexact_;
+
+  DISALLOW_COPY_AND_ASSIGN(ShardedHierarchy);
+};
+
+#endif //CACHE_SHARD_H_
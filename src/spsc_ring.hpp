@@ -0,0 +1,71 @@
+#ifndef CACHE_SPSC_RING_H_
+#define CACHE_SPSC_RING_H_
+
+#include <stddef.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "storage.hpp"
+
+using namespace std;
+
+// Lock-free ring for exactly one producer thread and one consumer thread
+template <typename T>
+class SpscRing {
+ public:
+  // capacity is rounded up to a power of two
+  explicit SpscRing(size_t capacity) : head_(0), tail_(0) {
+    size_t n = 2;
+    while (n < capacity)
+      n <<= 1;
+    slots_.resize(n);
+    mask_ = n - 1;
+  }
+  ~SpscRing() {}
+
+  bool TryPush(const T &x) {
+    size_t tail = tail_.load(memory_order_relaxed);
+    if (tail - head_.load(memory_order_acquire) > mask_)
+      return false;
+    slots_[tail & mask_] = x;
+    tail_.store(tail + 1, memory_order_release);
+    return true;
+  }
+
+  bool TryPop(T &x) {
+    size_t head = head_.load(memory_order_relaxed);
+    if (head == tail_.load(memory_order_acquire))
+      return false;
+    x = slots_[head & mask_];
+    head_.store(head + 1, memory_order_release);
+    return true;
+  }
+
+  // Blocking versions, spin briefly and then back off to short sleeps
+  void Push(const T &x) {
+    for (int spins = 0; !TryPush(x); spins++)
+      Backoff(spins);
+  }
+
+  void Pop(T &x) {
+    for (int spins = 0; !TryPop(x); spins++)
+      Backoff(spins);
+  }
+
+ private:
+  static void Backoff(int spins) {
+    if (spins < 64)
+      this_thread::yield();
+    else
+      this_thread::sleep_for(chrono::microseconds(50));
+  }
+
+  vector<T> slots_;
+  size_t mask_;
+  alignas(64) atomic<size_t> head_; // Next slot to pop, written by the consumer
+  alignas(64) atomic<size_t> tail_; // Next slot to push, written by the producer
+  DISALLOW_COPY_AND_ASSIGN(SpscRing);
+};
+
+#endif //CACHE_SPSC_RING_H_
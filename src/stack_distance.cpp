@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <cstring>
+#include "stack_distance.hpp"
+
+static bool is_pow2(uint64_t x) {
+  return x && !(x & (x - 1));
+}
+
+// splitmix64 finalizer
+static uint64_t mix64(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+StackDistance::StackDistance() : tree_(STACK_DISTANCE_MIN_CAPACITY + 1, 0), now_(0) {}
+
+void StackDistance::Add(uint64_t pos, int delta) {
+  for (; pos < tree_.size(); pos += pos & -pos)
+    tree_[pos] += delta;
+}
+
+uint64_t StackDistance::Prefix(uint64_t pos) const {
+  uint64_t sum = 0;
+  for (; pos; pos -= pos & -pos)
+    sum += tree_[pos];
+  return sum;
+}
+
+void StackDistance::Compact() {
+  // Renumber the latest accesses 1..n in order, every time is then marked
+  vector<pair<uint64_t, uint64_t>> order;
+  order.reserve(last_.size());
+  for (auto &entry: last_)
+    order.emplace_back(entry.second, entry.first);
+  sort(order.begin(), order.end());
+  for (size_t i = 0; i < order.size(); i++)
+    last_[order[i].second] = i + 1;
+  now_ = order.size();
+
+  size_t capacity = tree_.size() - 1;
+  while (capacity < 2 * now_)
+    capacity *= 2;
+  tree_.assign(capacity + 1, 0);
+  for (uint64_t pos = 1; pos <= capacity; pos++) {
+    tree_[pos] += pos <= now_;
+    auto parent = pos + (pos & -pos);
+    if (parent < tree_.size())
+      tree_[parent] += tree_[pos];
+  }
+}
+
+uint64_t StackDistance::Access(uint64_t block) {
+  if (now_ + 1 == tree_.size())
+    Compact();
+  uint64_t distance = STACK_DISTANCE_COLD;
+  auto it = last_.try_emplace(block, 0).first;
+  if (it->second) {
+    distance = last_.size() - Prefix(it->second);
+    Add(it->second, -1);
+  }
+  it->second = ++now_;
+  Add(now_, 1);
+  return distance;
+}
+
+SetStackDistance::SetStackDistance(uint64_t set_num, int depth)
+    : set_num_(set_num), depth_(depth), stacks_(set_num * depth, UINT64_MAX) {}
+
+int SetStackDistance::Access(uint64_t block) {
+  auto stack = &stacks_[(block & (set_num_ - 1)) * depth_];
+  int pos = 0;
+  while (pos < depth_ && stack[pos] != block)
+    pos++;
+  // Move to the front, dropping the least recent block on a miss
+  int hit = pos < depth_ ? pos : -1;
+  size_t moved = hit < 0 ? depth_ - 1 : hit;
+  memmove(stack + 1, stack, sizeof(uint64_t) * moved);
+  stack[0] = block;
+  return hit;
+}
+
+bool MissRatioCurve::Init(const MrcConfig &mc) {
+  if (!is_pow2(mc.block_size) || !is_pow2(mc.min_size) || !is_pow2(mc.max_size)) return false;
+  if (mc.min_size > mc.max_size || mc.max_size < (uint64_t) mc.block_size) return false;
+  if (mc.sample_rate <= 0 || mc.sample_rate > 1) return false;
+  for (int assoc: mc.assoc) {
+    if (!is_pow2(assoc)) return false;
+  }
+  config_ = mc;
+  block_bits_ = __builtin_ctz(mc.block_size);
+  threshold_ = (uint64_t) (mc.sample_rate * (1 << 24));
+  accesses_ = 0;
+  full_accesses_ = 0;
+  full_hist_.assign(mc.max_size / mc.block_size, 0);
+
+  levels_.clear();
+  level_sampled_.clear();
+  level_accesses_.clear();
+  level_hist_.clear();
+  if (mc.assoc.empty())
+    return true;
+  depth_ = *max_element(mc.assoc.begin(), mc.assoc.end());
+  int min_assoc = *min_element(mc.assoc.begin(), mc.assoc.end());
+  min_sets_ = max<uint64_t>(1, mc.min_size / mc.block_size / depth_);
+  uint64_t max_sets = max<uint64_t>(1, mc.max_size / mc.block_size / min_assoc);
+  for (uint64_t sets = min_sets_; sets <= max_sets; sets *= 2) {
+    levels_.emplace_back(new SetStackDistance(sets, depth_));
+    level_sampled_.push_back(mc.sample_rate < 1 && sets * mc.sample_rate >= MRC_MIN_SAMPLED_SETS);
+  }
+  level_accesses_.assign(levels_.size(), 0);
+  level_hist_.assign(levels_.size() * depth_, 0);
+  return true;
+}
+
+bool MissRatioCurve::Sampled(uint64_t key) const {
+  return (mix64(key) >> 40) < threshold_;
+}
+
+void MissRatioCurve::Access(uint64_t addr) {
+  uint64_t block = addr >> block_bits_;
+  accesses_++;
+
+  if (config_.sample_rate == 1 || Sampled(block)) {
+    full_accesses_++;
+    // Cold misses and distances past the largest size miss everywhere
+    auto distance = full_.Access(block);
+    if (distance != STACK_DISTANCE_COLD && distance / config_.sample_rate < full_hist_.size())
+      full_hist_[(uint64_t) (distance / config_.sample_rate)]++;
+  }
+
+  for (size_t i = 0; i < levels_.size(); i++) {
+    if (level_sampled_[i] && !Sampled(block & ((min_sets_ << i) - 1)))
+      continue;
+    level_accesses_[i]++;
+    int pos = levels_[i]->Access(block);
+    if (pos >= 0)
+      level_hist_[i * depth_ + pos]++;
+  }
+}
+
+double MissRatioCurve::MissRatio(uint64_t size, int assoc) const {
+  uint64_t blocks = size / config_.block_size;
+  if (!assoc) {
+    if (!full_accesses_)
+      return 0;
+    uint64_t hits = 0;
+    for (uint64_t d = 0; d < min<uint64_t>(blocks, full_hist_.size()); d++)
+      hits += full_hist_[d];
+    return (double) (full_accesses_ - hits) / full_accesses_;
+  }
+  if (assoc > depth_ || blocks < (uint64_t) assoc)
+    return -1;
+  uint64_t sets = blocks / assoc;
+  if (sets < min_sets_)
+    return -1;
+  size_t level = __builtin_ctzll(sets / min_sets_);
+  if (level >= levels_.size())
+    return -1;
+  if (!level_accesses_[level])
+    return 0;
+  uint64_t hits = 0;
+  for (int pos = 0; pos < assoc; pos++)
+    hits += level_hist_[level * depth_ + pos];
+  return (double) (level_accesses_[level] - hits) / level_accesses_[level];
+}
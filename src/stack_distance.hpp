@@ -0,0 +1,118 @@
+#ifndef CACHE_STACK_DISTANCE_H_
+#define CACHE_STACK_DISTANCE_H_
+
+#include <stdint.h>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "storage.hpp"
+
+using namespace std;
+
+#define STACK_DISTANCE_COLD UINT64_MAX // First access to a block
+#define STACK_DISTANCE_MIN_CAPACITY (1 << 16)
+#define MRC_MIN_SAMPLED_SETS 32 // Set counts below this many sampled sets run unsampled
+
+// LRU stack distance of a block stream: the number of distinct blocks touched
+// since the previous access to the same block, so a fully associative LRU
+// cache of C blocks hits iff distance < C. A Fenwick tree over access times
+// marks the latest access of every block; once the times run out they are
+// renumbered, so memory follows the footprint rather than the trace length.
+class StackDistance {
+ public:
+  StackDistance();
+  ~StackDistance() {}
+
+  uint64_t Access(uint64_t block);
+
+  size_t Blocks() const { return last_.size(); }
+
+ private:
+  void Add(uint64_t pos, int delta);
+
+  // Marks in [1, pos]
+  uint64_t Prefix(uint64_t pos) const;
+
+  void Compact();
+
+  vector<int32_t> tree_; // 1-based, tree_.size() - 1 usable times
+  uint64_t now_; // Last used time
+  unordered_map<uint64_t, uint64_t> last_; // Block -> time of its latest access
+
+  DISALLOW_COPY_AND_ASSIGN(StackDistance);
+};
+
+// LRU stacks of one set count. Each set keeps its depth most recent blocks,
+// so one pass gives the hits of every associativity up to depth.
+class SetStackDistance {
+ public:
+  SetStackDistance(uint64_t set_num, int depth);
+  ~SetStackDistance() {}
+
+  // Position of block in its set's stack, -1 if not within depth
+  int Access(uint64_t block);
+
+ private:
+  uint64_t set_num_;
+  int depth_;
+  vector<uint64_t> stacks_; // depth_ blocks per set, most recent first
+
+  DISALLOW_COPY_AND_ASSIGN(SetStackDistance);
+};
+
+typedef struct MrcConfig_ {
+  int block_size;
+  vector<int> assoc; // Associativities to report, powers of two
+  uint64_t min_size; // Smallest and largest cache size in bytes, powers of two
+  uint64_t max_size;
+  double sample_rate; // Fraction of blocks (fully associative) or sets kept, 1 for exact
+} MrcConfig;
+
+// Exact LRU miss ratio curves of a write-allocate cache for every power of
+// two size in [min_size, max_size], fully associative and for each
+// associativity, from one pass over the trace. With sample_rate < 1 the fully
+// associative curve hash-samples blocks and scales distances (SHARDS), and
+// the set associative curves hash-sample whole sets.
+class MissRatioCurve {
+ public:
+  MissRatioCurve() {}
+  ~MissRatioCurve() {}
+
+  // False for an invalid config
+  bool Init(const MrcConfig &mc);
+
+  void Access(uint64_t addr);
+
+  // Miss ratio of a size byte cache, assoc 0 for fully associative. Negative
+  // if the cache can't be built with this associativity.
+  double MissRatio(uint64_t size, int assoc) const;
+
+  uint64_t Accesses() const { return accesses_; }
+
+  const MrcConfig &GetConfig() const { return config_; }
+
+ private:
+  // Sampling filter, keeps a sample_rate fraction of keys
+  bool Sampled(uint64_t key) const;
+
+  MrcConfig config_;
+  int block_bits_;
+  int depth_; // Largest associativity
+  uint64_t min_sets_;
+  uint64_t threshold_; // Sampled() cut on a 24-bit hash
+  uint64_t accesses_;
+
+  StackDistance full_;
+  uint64_t full_accesses_; // Sampled accesses
+  vector<uint64_t> full_hist_; // Scaled distance -> count, up to max_size blocks
+
+  // One level per set count min_sets_ << i
+  vector<unique_ptr<SetStackDistance>> levels_;
+  vector<bool> level_sampled_;
+  vector<uint64_t> level_accesses_;
+  vector<uint64_t> level_hist_; // depth_ counts per level
+
+  DISALLOW_COPY_AND_ASSIGN(MissRatioCurve);
+};
+
+#endif //CACHE_STACK_DISTANCE_H_
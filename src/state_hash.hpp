@@ -0,0 +1,12 @@
+#ifndef CACHE_STATE_HASH_H_
+#define CACHE_STATE_HASH_H_
+
+#include <stdint.h>
+
+// One step of the order dependent 64-bit hashes of simulator state
+inline uint64_t state_hash_step(uint64_t hash, uint64_t value) {
+  hash = (hash ^ value) * 0xbf58476d1ce4e5b9ULL;
+  return hash ^ (hash >> 31);
+}
+
+#endif //CACHE_STATE_HASH_H_
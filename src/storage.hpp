@@ -1,6 +1,7 @@
 #ifndef CACHE_STORAGE_H_
 #define CACHE_STORAGE_H_
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 
@@ -16,8 +17,33 @@ typedef struct StorageStats_ {
   int replace_num; // Evict old lines
   int fetch_num; // Fetch lower layer
   int prefetch_num; // Prefetch
+  int bypass_num; // Misses the bypass predictor left uncached
+  int bypass_miss_num; // Misses on a block bypassed shortly before, see BypassPredictor
+  int keep_num; // Misses of a full set the bypass predictor filled
+  int dead_num; // Of those, lines evicted without a hit
+  int useful_prefetch_num; // Prefetched lines hit by a demand access
+  int useless_prefetch_num; // Prefetched lines evicted without one
+  int polluting_prefetch_num; // Demand misses on blocks evicted for a prefetch shortly before
+  int merge_num; // Timing mode: demand hits on lines whose fill was still in flight
+  int mshr_stall_time; // Timing mode: cycles demand misses waited for a free MSHR
+  int byte_num; // Memory: bytes moved, whole bursts for DRAM
+  int row_hit_num; // DRAM: bursts to the open row of their bank
+  int row_conflict_num; // DRAM: bursts that had to close another row first
 } StorageStats;
 
+// One demand request of a batch
+typedef struct AccessRequest_ {
+  uint64_t addr;
+  int bytes;
+  int read; // 0|1 for write|read
+} AccessRequest;
+
+// What HandleRequest would have returned for it
+typedef struct AccessResult_ {
+  int hit;
+  int time;
+} AccessResult;
+
 // Storage basic config
 typedef struct StorageLatency_ {
   int hit_latency; // In nanoseconds
@@ -26,7 +52,7 @@ typedef struct StorageLatency_ {
 
 class Storage {
  public:
-  Storage() {}
+  Storage() : cycle_(0) {}
   ~Storage() {}
 
   // Sets & Gets
@@ -35,19 +61,32 @@ class Storage {
   void SetLatency(StorageLatency sl) { latency_ = sl; }
   void GetLatency(StorageLatency &sl) { sl = latency_; }
 
+  // Cycle the next request arrives at, only read by the non-blocking timing
+  // model, see CacheConfig::mshrs. time is still counted from the arrival.
+  void SetCycle(uint64_t cycle) { cycle_ = cycle; }
+
   // Main access process
   // [in]  addr: access address
   // [in]  bytes: target number of bytes
   // [in]  read: 0|1 for write|read
-  // [i|o] content: in|out data
+  // [i|o] content: in|out data, may be nullptr in tag-only simulation
   // [out] hit: 0|1 for miss|hit
   // [out] time: total access time
   virtual void HandleRequest(uint64_t addr, int bytes, int read,
                              char *content, int &hit, int &time, bool prefetch = false) = 0;
 
+  // Handle reqs[0, n) in order, exactly like a HandleRequest call for each,
+  // with one virtual call for the whole batch. content is shared by the
+  // requests as it would be by the calls.
+  virtual void HandleBatch(const AccessRequest *reqs, size_t n, char *content, AccessResult *results) {
+    for (size_t i = 0; i < n; i++)
+      HandleRequest(reqs[i].addr, reqs[i].bytes, reqs[i].read, content, results[i].hit, results[i].time);
+  }
+
  protected:
   StorageStats stats_;
   StorageLatency latency_;
+  uint64_t cycle_;
 };
 
 #endif //CACHE_STORAGE_H_ 
@@ -0,0 +1,96 @@
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include "thread_pool.hpp"
+#include "sweep.hpp"
+
+bool expand_sweep_grid(const SweepPoint &base, const vector<string> &axes, vector<SweepPoint> &points) {
+  points.assign(1, base);
+  for (auto &axis: axes) {
+    auto eq = axis.find('=');
+    if (eq == string::npos) {
+      cerr << "Malformed sweep axis " << axis << endl;
+      return false;
+    }
+    auto key = axis.substr(0, eq);
+    stringstream values(axis.substr(eq + 1));
+    vector<SweepPoint> expanded;
+    for (string value; getline(values, value, ',');) {
+      for (auto point: points) {
+        if (!apply_hierarchy_setting(point, key, value)) {
+          cerr << "Invalid sweep setting " << key << "=" << value << endl;
+          return false;
+        }
+        expanded.push_back(point);
+      }
+    }
+    points.swap(expanded);
+  }
+  return true;
+}
+
+bool load_sweep_list(const string &path, const SweepPoint &base, vector<SweepPoint> &points) {
+  ifstream file(path);
+  if (!file) {
+    cerr << "Can't open sweep list " << path << endl;
+    return false;
+  }
+  string line;
+  for (int line_num = 1; getline(file, line); line_num++) {
+    line = line.substr(0, line.find('#'));
+    stringstream settings(line);
+    SweepPoint point = base;
+    bool empty = true;
+    for (string setting; settings >> setting; empty = false) {
+      auto eq = setting.find('=');
+      if (eq == string::npos || !apply_hierarchy_setting(point, setting.substr(0, eq), setting.substr(eq + 1))) {
+        cerr << "Invalid sweep setting " << setting << " on line " << line_num << " of " << path << endl;
+        return false;
+      }
+    }
+    if (!empty)
+      points.push_back(point);
+  }
+  return true;
+}
+
+// Build each point's hierarchy on the pool and simulate it with run
+static void run_points(const vector<SweepPoint> &points, int threads, vector<SweepResult> &results,
+                       const function<void(Hierarchy &)> &run) {
+  results.assign(points.size(), SweepResult());
+  ThreadPool pool(min<int>(threads > 0 ? threads : hardware_threads(), max<size_t>(points.size(), 1)));
+  pool.ParallelFor(points.size(), [&](size_t i) {
+    auto &result = results[i];
+    auto config = points[i];
+    for (auto &level: config.levels)
+      level.cache.tag_only = true;
+    Hierarchy hierarchy;
+    result.valid = hierarchy.Init(config);
+    if (!result.valid)
+      return;
+    auto start = chrono::steady_clock::now();
+    run(hierarchy);
+    result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    hierarchy.L1()->GetStats(result.l1);
+    hierarchy.L2()->GetStats(result.l2);
+    hierarchy.Mem()->GetStats(result.mem);
+    result.total = hierarchy.GetStats();
+    result.amat = hierarchy.Amat();
+  });
+}
+
+void run_sweep(const vector<TraceRequest> &requests, int iter, const vector<SweepPoint> &points, int threads,
+               vector<SweepResult> &results) {
+  run_points(points, threads, results, [&](Hierarchy &hierarchy) {
+    hierarchy.Run(requests, iter);
+  });
+}
+
+void run_sweep(const MissStreamHeader &header, const vector<PipelineRecord> &records,
+               const vector<SweepPoint> &points, int threads, vector<SweepResult> &results) {
+  run_points(points, threads, results, [&](Hierarchy &hierarchy) {
+    replay_miss_stream(header, records, hierarchy);
+  });
+}
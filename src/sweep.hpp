@@ -0,0 +1,46 @@
+#ifndef CACHE_SWEEP_H_
+#define CACHE_SWEEP_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "cache.hpp"
+#include "hierarchy.hpp"
+#include "hierarchy_config.hpp"
+#include "miss_stream.hpp"
+#include "trace.hpp"
+
+using namespace std;
+
+// One hierarchy of a design space sweep, of at least two levels
+typedef HierarchyConfig SweepPoint;
+
+typedef struct SweepResult_ {
+  bool valid; // False if a cache config was rejected
+  StorageStats l1;
+  StorageStats l2;
+  StorageStats mem;
+  HierarchyStats total;
+  double amat;
+  double seconds;
+} SweepResult;
+
+// Cartesian product of axes such as "l1.size=16K,32K" over base, keys as
+// accepted by apply_hierarchy_setting()
+bool expand_sweep_grid(const SweepPoint &base, const vector<string> &axes, vector<SweepPoint> &points);
+
+// One point per line of whitespace separated key=value settings over base,
+// blank lines and # comments are skipped. Reports the bad line on failure.
+bool load_sweep_list(const string &path, const SweepPoint &base, vector<SweepPoint> &points);
+
+// Simulate every point over the shared trace on a work-stealing pool of
+// threads workers (<= 0 for one per hardware thread). The caches run tag
+// only, which never changes the stats.
+void run_sweep(const vector<TraceRequest> &requests, int iter, const vector<SweepPoint> &points, int threads,
+               vector<SweepResult> &results);
+
+// Same over a recorded L1 miss stream, only the L2 settings of the points matter
+void run_sweep(const MissStreamHeader &header, const vector<PipelineRecord> &records,
+               const vector<SweepPoint> &points, int threads, vector<SweepResult> &results);
+
+#endif //CACHE_SWEEP_H_
@@ -0,0 +1,63 @@
+#include "state_hash.hpp"
+#include "tag_ring.hpp"
+
+void TagRing::Reset(int set_num, int capacity) {
+  capacity_ = capacity;
+  tags_.assign((size_t) set_num * capacity, 0);
+  heads_.assign(set_num, 0);
+  sizes_.assign(set_num, 0);
+  filters_.assign(set_num, 0);
+}
+
+int TagRing::Find(uint64_t set_idx, uint64_t tag) const {
+  auto ring = &tags_[set_idx * capacity_];
+  for (uint32_t i = 0; i < sizes_[set_idx]; i++) {
+    int slot = (heads_[set_idx] + i) % capacity_;
+    if (ring[slot] == tag)
+      return slot;
+  }
+  return -1;
+}
+
+void TagRing::Refilter(uint64_t set_idx) {
+  auto ring = &tags_[set_idx * capacity_];
+  uint64_t filter = 0;
+  for (uint32_t i = 0; i < sizes_[set_idx]; i++)
+    filter |= FilterBit(ring[(heads_[set_idx] + i) % capacity_]);
+  filters_[set_idx] = filter;
+}
+
+void TagRing::Push(uint64_t set_idx, uint64_t tag) {
+  auto ring = &tags_[set_idx * capacity_];
+  auto &head = heads_[set_idx], &size = sizes_[set_idx];
+  if ((int) size == capacity_) {
+    ring[head] = tag;
+    head = (head + 1) % capacity_;
+    Refilter(set_idx); // The dropped tag may have owned a bit
+  } else {
+    ring[(head + size++) % capacity_] = tag;
+    filters_[set_idx] |= FilterBit(tag);
+  }
+}
+
+void TagRing::Erase(uint64_t set_idx, uint64_t tag) {
+  int slot = Find(set_idx, tag);
+  if (slot < 0)
+    return;
+  // Shift the newer entries down so the rest stay oldest first
+  auto ring = &tags_[set_idx * capacity_];
+  auto &size = sizes_[set_idx];
+  uint32_t i = (slot - heads_[set_idx] + capacity_) % capacity_;
+  for (; i + 1 < size; i++)
+    ring[(heads_[set_idx] + i) % capacity_] = ring[(heads_[set_idx] + i + 1) % capacity_];
+  size--;
+  Refilter(set_idx);
+}
+
+uint64_t TagRing::Hash(uint64_t set_idx) const {
+  auto ring = &tags_[set_idx * capacity_];
+  uint64_t hash = 0;
+  for (uint32_t i = 0; i < sizes_[set_idx]; i++)
+    hash = state_hash_step(hash, ring[(heads_[set_idx] + i) % capacity_]);
+  return state_hash_step(hash, sizes_[set_idx]);
+}
@@ -0,0 +1,47 @@
+#ifndef CACHE_TAG_RING_H_
+#define CACHE_TAG_RING_H_
+
+#include <stdint.h>
+#include <vector>
+
+using namespace std;
+
+// Per set FIFO rings of recent tags. A 64-bit filter per set holds one bit
+// per hashed tag, so a lookup only scans the ring when the bit of its tag is
+// set, and pushes only touch the ring and the filter.
+class TagRing {
+ public:
+  TagRing() : capacity_(0) {}
+
+  void Reset(int set_num, int capacity);
+
+  bool Contains(uint64_t set_idx, uint64_t tag) const {
+    return (filters_[set_idx] & FilterBit(tag)) && Find(set_idx, tag) >= 0;
+  }
+  bool Full(uint64_t set_idx) const { return (int) sizes_[set_idx] == capacity_; }
+
+  // Append tag, dropping the oldest entry of a full ring
+  void Push(uint64_t set_idx, uint64_t tag);
+
+  // Drop tag if present, keeping the others in order
+  void Erase(uint64_t set_idx, uint64_t tag);
+
+  // Hash of the tags of a set oldest first
+  uint64_t Hash(uint64_t set_idx) const;
+
+ private:
+  static uint64_t FilterBit(uint64_t tag) { return 1ULL << ((tag * 0x9e3779b97f4a7c15ULL) >> 58); }
+
+  // Slot of tag in the ring, -1 if absent
+  int Find(uint64_t set_idx, uint64_t tag) const;
+
+  void Refilter(uint64_t set_idx);
+
+  int capacity_;
+  vector<uint64_t> tags_; // capacity_ slots per set
+  vector<uint32_t> heads_; // Slot of the oldest entry
+  vector<uint32_t> sizes_;
+  vector<uint64_t> filters_;
+};
+
+#endif //CACHE_TAG_RING_H_
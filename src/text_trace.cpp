@@ -0,0 +1,299 @@
+#include <string.h>
+#include <algorithm>
+#include "text_trace.hpp"
+#include "mapped_file.hpp"
+#include "thread_pool.hpp"
+
+// Smallest chunk worth handing to another thread
+#define PARSE_CHUNK_MIN_SIZE (1 << 20)
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#endif
+
+typedef struct TextLine_ {
+  const char *start;
+  const char *token; // First char after the 0x prefix
+  const char *eol;   // '\n' or end
+  char op;
+} TextLine;
+
+static inline bool is_blank(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static inline int hex_value(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  c |= 0x20;
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  return -1;
+}
+
+// Decode hex digits at p, returns the number of chars consumed, 0 if there is
+// no digit or the value doesn't fit 64 bits
+static int decode_hex_scalar(const char *p, const char *end, uint64_t &value) {
+  const char *start = p;
+  uint64_t x = 0;
+  int significant = 0;
+  while (p < end) {
+    int d = hex_value(*p);
+    if (d < 0)
+      break;
+    if ((x || d) && ++significant > 16)
+      return 0;
+    x = x << 4 | d;
+    p++;
+  }
+  value = x;
+  return p - start;
+}
+
+#ifdef HAVE_X86_KERNELS
+
+// kAlignMask[n] moves the first n bytes to the top of the register and zeroes the rest
+struct AlignMasks {
+  alignas(16) uint8_t mask[17][16];
+  AlignMasks() {
+    for (int n = 0; n <= 16; n++)
+      for (int j = 0; j < 16; j++)
+        mask[n][j] = j >= 16 - n ? j - (16 - n) : 0x80;
+  }
+};
+static const AlignMasks kAlignMask;
+
+// Nibble values and the mask of hex digits for 16 chars
+__attribute__((target("ssse3")))
+static inline __m128i hex_nibbles_128(__m128i v, uint32_t &mask) {
+  __m128i digit = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+  __m128i alpha = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+  __m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+  __m128i is_alpha = _mm_cmpeq_epi8(_mm_min_epu8(alpha, _mm_set1_epi8(5)), alpha);
+  mask = _mm_movemask_epi8(_mm_or_si128(is_digit, is_alpha));
+  return _mm_or_si128(_mm_and_si128(is_digit, digit),
+                      _mm_and_si128(is_alpha, _mm_add_epi8(alpha, _mm_set1_epi8(10))));
+}
+
+__attribute__((target("ssse3")))
+static int decode_hex_ssse3(const char *p, const char *end, uint64_t &value) {
+  if (end - p < 16)
+    return decode_hex_scalar(p, end, value);
+  uint32_t mask;
+  __m128i nib = hex_nibbles_128(_mm_loadu_si128((const __m128i *) p), mask);
+  int n = __builtin_ctz(~mask);
+  if (n == 0 || n == 16) // No digit or possibly zero padded past 16 digits
+    return decode_hex_scalar(p, end, value);
+  // Right align the digits, then fold nibble pairs into bytes
+  nib = _mm_shuffle_epi8(nib, _mm_load_si128((const __m128i *) kAlignMask.mask[n]));
+  __m128i pairs = _mm_maddubs_epi16(nib, _mm_set1_epi16(0x0110));
+  __m128i bytes = _mm_packus_epi16(pairs, pairs);
+  value = __builtin_bswap64(_mm_cvtsi128_si64(bytes));
+  return n;
+}
+
+// Same as decode_hex_ssse3 for two tokens, one per 128-bit lane
+__attribute__((target("avx2")))
+static void decode_hex_avx2(const char *p0, const char *p1, const char *end, uint64_t value[2], int len[2]) {
+  if (end - p0 < 16 || end - p1 < 16) {
+    len[0] = decode_hex_scalar(p0, end, value[0]);
+    len[1] = decode_hex_scalar(p1, end, value[1]);
+    return;
+  }
+  __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) p0)),
+                                      _mm_loadu_si128((const __m128i *) p1), 1);
+  __m256i digit = _mm256_sub_epi8(v, _mm256_set1_epi8('0'));
+  __m256i alpha = _mm256_sub_epi8(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+  __m256i is_digit = _mm256_cmpeq_epi8(_mm256_min_epu8(digit, _mm256_set1_epi8(9)), digit);
+  __m256i is_alpha = _mm256_cmpeq_epi8(_mm256_min_epu8(alpha, _mm256_set1_epi8(5)), alpha);
+  uint32_t mask = _mm256_movemask_epi8(_mm256_or_si256(is_digit, is_alpha));
+  __m256i nib = _mm256_or_si256(_mm256_and_si256(is_digit, digit),
+                                _mm256_and_si256(is_alpha, _mm256_add_epi8(alpha, _mm256_set1_epi8(10))));
+  int n0 = __builtin_ctz((~mask & 0xffff) | 0x10000);
+  int n1 = __builtin_ctz((~mask >> 16) | 0x10000);
+  __m256i align = _mm256_inserti128_si256(
+      _mm256_castsi128_si256(_mm_load_si128((const __m128i *) kAlignMask.mask[n0])),
+      _mm_load_si128((const __m128i *) kAlignMask.mask[n1]), 1);
+  nib = _mm256_shuffle_epi8(nib, align);
+  __m256i pairs = _mm256_maddubs_epi16(nib, _mm256_set1_epi16(0x0110));
+  __m256i bytes = _mm256_packus_epi16(pairs, pairs);
+  value[0] = __builtin_bswap64(_mm256_extract_epi64(bytes, 0));
+  value[1] = __builtin_bswap64(_mm256_extract_epi64(bytes, 2));
+  len[0] = n0;
+  len[1] = n1;
+  if (n0 == 0 || n0 == 16)
+    len[0] = decode_hex_scalar(p0, end, value[0]);
+  if (n1 == 0 || n1 == 16)
+    len[1] = decode_hex_scalar(p1, end, value[1]);
+}
+
+#endif // HAVE_X86_KERNELS
+
+bool hex_kernel_supported(HexKernel kernel) {
+  switch (kernel) {
+    case kHexScalar:
+      return true;
+#ifdef HAVE_X86_KERNELS
+    case kHexSsse3:
+      return __builtin_cpu_supports("ssse3");
+    case kHexAvx2:
+      return __builtin_cpu_supports("avx2");
+#endif
+    default:
+      return false;
+  }
+}
+
+HexKernel best_hex_kernel() {
+  static const HexKernel best = hex_kernel_supported(kHexAvx2) ? kHexAvx2 :
+                                hex_kernel_supported(kHexSsse3) ? kHexSsse3 : kHexScalar;
+  return best;
+}
+
+const char *hex_kernel_name(HexKernel kernel) {
+  switch (kernel) {
+    case kHexScalar: return "scalar";
+    case kHexSsse3: return "ssse3";
+    case kHexAvx2: return "avx2";
+  }
+  return "unknown";
+}
+
+const char *next_line(const char *p, const char *end) {
+  if (p >= end)
+    return end;
+  auto eol = static_cast<const char *>(memchr(p, '\n', end - p));
+  return eol ? eol + 1 : end;
+}
+
+// Split off the next line, returns false for a blank line
+static inline bool scan_line(const char *&p, const char *end, TextLine &line) {
+  line.start = p;
+  while (p < end && is_blank(*p))
+    p++;
+  if (p == end || *p == '\n') {
+    p = p < end ? p + 1 : end;
+    return false;
+  }
+  line.op = *p++;
+  while (p < end && is_blank(*p))
+    p++;
+  if (end - p >= 2 && p[0] == '0' && (p[1] | 0x20) == 'x')
+    p += 2;
+  line.token = p;
+  auto eol = static_cast<const char *>(memchr(p, '\n', end - p));
+  line.eol = eol ? eol : end;
+  p = eol ? eol + 1 : end;
+  return true;
+}
+
+// Check what follows the n decoded digits and append the request
+static inline bool finish_line(const TextLine &line, int n, uint64_t addr, vector<TraceRequest> &requests) {
+  if (n == 0)
+    return false;
+  for (const char *c = line.token + n; c < line.eol; c++) {
+    if (!is_blank(*c))
+      return false;
+  }
+  requests.push_back({addr, line.op == 'r'});
+  return true;
+}
+
+static inline int decode_hex(HexKernel kernel, const char *p, const char *end, uint64_t &value) {
+#ifdef HAVE_X86_KERNELS
+  if (kernel != kHexScalar)
+    return decode_hex_ssse3(p, end, value);
+#endif
+  return decode_hex_scalar(p, end, value);
+}
+
+bool parse_text_trace(const char *begin, const char *end, vector<TraceRequest> &requests,
+                      HexKernel kernel, const char **error) {
+  const char *p = begin;
+  TextLine a, b;
+  uint64_t value[2];
+  int len[2];
+  while (p < end) {
+    if (!scan_line(p, end, a))
+      continue;
+#ifdef HAVE_X86_KERNELS
+    if (kernel == kHexAvx2) {
+      bool paired = false;
+      while (p < end && !(paired = scan_line(p, end, b)));
+      if (paired) {
+        decode_hex_avx2(a.token, b.token, end, value, len);
+        if (!finish_line(a, len[0], value[0], requests)) {
+          if (error) *error = a.start;
+          return false;
+        }
+        if (!finish_line(b, len[1], value[1], requests)) {
+          if (error) *error = b.start;
+          return false;
+        }
+        continue;
+      }
+    }
+#endif
+    len[0] = decode_hex(kernel, a.token, end, value[0]);
+    if (!finish_line(a, len[0], value[0], requests)) {
+      if (error) *error = a.start;
+      return false;
+    }
+  }
+  return true;
+}
+
+bool parse_text_trace_parallel(const char *begin, const char *end, vector<TraceRequest> &requests,
+                               HexKernel kernel, int threads, const char **error) {
+  size_t size = end - begin;
+  if (threads <= 0)
+    threads = hardware_threads();
+  size_t chunk_num = min<size_t>(threads * 4, size / PARSE_CHUNK_MIN_SIZE);
+  if (threads == 1 || chunk_num <= 1)
+    return parse_text_trace(begin, end, requests, kernel, error);
+
+  vector<const char *> bounds(chunk_num + 1);
+  bounds[0] = begin;
+  for (size_t i = 1; i < chunk_num; i++)
+    bounds[i] = max(bounds[i - 1], next_line(begin + i * (size / chunk_num) - 1, end));
+  bounds[chunk_num] = end;
+
+  ThreadPool pool(min<int>(threads, chunk_num));
+  vector<vector<TraceRequest>> parts(chunk_num);
+  vector<const char *> errors(chunk_num, nullptr);
+  vector<char> ok(chunk_num);
+  pool.ParallelFor(chunk_num, [&](size_t i) {
+    parts[i].reserve((bounds[i + 1] - bounds[i]) / 10);
+    ok[i] = parse_text_trace(bounds[i], bounds[i + 1], parts[i], kernel, &errors[i]);
+  });
+
+  vector<size_t> offsets(chunk_num + 1, requests.size());
+  for (size_t i = 0; i < chunk_num; i++) {
+    if (!ok[i]) {
+      if (error) *error = errors[i];
+      return false;
+    }
+    offsets[i + 1] = offsets[i] + parts[i].size();
+  }
+  requests.resize(offsets[chunk_num]);
+  pool.ParallelFor(chunk_num, [&](size_t i) {
+    copy(parts[i].begin(), parts[i].end(), requests.begin() + offsets[i]);
+    vector<TraceRequest>().swap(parts[i]);
+  });
+  return true;
+}
+
+bool load_text_trace(const string &path, vector<TraceRequest> &requests, int threads) {
+  MappedFile file;
+  if (!file.Open(path))
+    return false;
+  const char *begin = file.Data(), *end = begin + file.Size();
+  const char *error = nullptr;
+  requests.clear();
+  if (threads == 1)
+    requests.reserve(file.Size() / 10);
+  if (!parse_text_trace_parallel(begin, end, requests, best_hex_kernel(), threads, &error)) {
+    fprintf(stderr, "Malformed trace line %ld in %s\n", 1 + count(begin, error, '\n'), path.c_str());
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,42 @@
+#ifndef CACHE_TEXT_TRACE_H_
+#define CACHE_TEXT_TRACE_H_
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "trace.hpp"
+
+using namespace std;
+
+// Hex address decoding kernels, chosen at runtime from the host CPU
+enum HexKernel {
+  kHexScalar,
+  kHexSsse3, // 16 digits per token
+  kHexAvx2,  // Two tokens per call
+};
+
+// Best kernel supported by the host
+HexKernel best_hex_kernel();
+
+const char *hex_kernel_name(HexKernel kernel);
+
+bool hex_kernel_supported(HexKernel kernel);
+
+// First line start at or after p, or end
+const char *next_line(const char *p, const char *end);
+
+// Parse "op 0xaddr" lines in [begin, end) and append them to requests. Blank
+// lines and trailing tabs/CRs are skipped, addresses may be zero padded.
+// Returns false on the first malformed line, its start is stored in error.
+bool parse_text_trace(const char *begin, const char *end, vector<TraceRequest> &requests,
+                      HexKernel kernel, const char **error = nullptr);
+
+// parse_text_trace on newline aligned chunks in parallel, the requests are
+// stitched back together in trace order
+bool parse_text_trace_parallel(const char *begin, const char *end, vector<TraceRequest> &requests,
+                               HexKernel kernel, int threads, const char **error = nullptr);
+
+// mmap path and parse it with the best kernel on threads workers
+bool load_text_trace(const string &path, vector<TraceRequest> &requests, int threads = 1);
+
+#endif //CACHE_TEXT_TRACE_H_
@@ -0,0 +1,100 @@
+#include "thread_pool.hpp"
+
+// Pool and deque of the worker running on this thread
+static thread_local ThreadPool *current_pool = nullptr;
+static thread_local int current_worker = -1;
+
+int hardware_threads() {
+  int n = thread::hardware_concurrency();
+  return n > 0 ? n : 1;
+}
+
+ThreadPool::ThreadPool(int threads) : next_queue_(0), queued_(0), pending_(0), stop_(false) {
+  if (threads <= 0)
+    threads = hardware_threads();
+  for (int i = 0; i < threads; i++)
+    queues_.emplace_back(new WorkQueue());
+  for (int i = 0; i < threads; i++)
+    workers_.emplace_back([this, i] { Worker(i); });
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    lock_guard<mutex> lock(mutex_);
+    stop_ = true;
+  }
+  task_cv_.notify_all();
+  for (auto &worker: workers_)
+    worker.join();
+}
+
+void ThreadPool::Submit(function<void()> task) {
+  int index = current_pool == this ? current_worker : next_queue_++ % queues_.size();
+  {
+    lock_guard<mutex> lock(mutex_);
+    pending_++;
+  }
+  {
+    lock_guard<mutex> guard(queues_[index]->lock);
+    queues_[index]->tasks.push_back(move(task));
+  }
+  {
+    lock_guard<mutex> lock(mutex_);
+    queued_++;
+  }
+  task_cv_.notify_one();
+}
+
+void ThreadPool::Wait() {
+  unique_lock<mutex> lock(mutex_);
+  done_cv_.wait(lock, [this] { return pending_ == 0; });
+}
+
+void ThreadPool::ParallelFor(size_t n, const function<void(size_t)> &fn) {
+  for (size_t i = 0; i < n; i++)
+    Submit([&fn, i] { fn(i); });
+  Wait();
+}
+
+bool ThreadPool::Pop(int index, function<void()> &task) {
+  for (size_t i = 0; i < queues_.size(); i++) {
+    auto &queue = *queues_[(index + i) % queues_.size()];
+    lock_guard<mutex> guard(queue.lock);
+    if (queue.tasks.empty())
+      continue;
+    if (i == 0) {
+      task = move(queue.tasks.back());
+      queue.tasks.pop_back();
+    } else {
+      task = move(queue.tasks.front());
+      queue.tasks.pop_front();
+    }
+    return true;
+  }
+  return false;
+}
+
+void ThreadPool::Worker(int index) {
+  current_pool = this;
+  current_worker = index;
+  while (true) {
+    function<void()> task;
+    if (!Pop(index, task)) {
+      unique_lock<mutex> lock(mutex_);
+      if (stop_ && queued_ <= 0)
+        return;
+      task_cv_.wait(lock, [this] { return stop_ || queued_ > 0; });
+      continue;
+    }
+    {
+      lock_guard<mutex> lock(mutex_);
+      queued_--;
+    }
+    task();
+    {
+      lock_guard<mutex> lock(mutex_);
+      if (--pending_ == 0)
+        done_cv_.notify_all();
+    }
+  }
+}
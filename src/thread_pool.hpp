@@ -0,0 +1,63 @@
+#ifndef CACHE_THREAD_POOL_H_
+#define CACHE_THREAD_POOL_H_
+
+#include <stddef.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "storage.hpp"
+
+using namespace std;
+
+// Fixed set of worker threads with a task deque each. Workers run their own
+// tasks newest first and steal the oldest task of another worker when they
+// run dry, so uneven tasks such as sweep configs still keep every core busy.
+class ThreadPool {
+ public:
+  // threads <= 0 uses one worker per hardware thread
+  explicit ThreadPool(int threads);
+  ~ThreadPool();
+
+  int Size() const { return workers_.size(); }
+
+  // Queued on the calling worker's deque, or round robin from other threads
+  void Submit(function<void()> task);
+
+  // Block until every submitted task has finished
+  void Wait();
+
+  // Run fn(0) .. fn(n - 1) on the pool and wait for them
+  void ParallelFor(size_t n, const function<void(size_t)> &fn);
+
+ private:
+  typedef struct WorkQueue_ {
+    mutex lock;
+    deque<function<void()>> tasks;
+  } WorkQueue;
+
+  void Worker(int index);
+
+  // Own newest task, else the oldest task of the next non-empty deque
+  bool Pop(int index, function<void()> &task);
+
+  vector<thread> workers_;
+  vector<unique_ptr<WorkQueue>> queues_;
+  atomic<size_t> next_queue_;
+  mutex mutex_; // Guards the counters below and the condition variables
+  condition_variable task_cv_;
+  condition_variable done_cv_;
+  long queued_; // Submitted and not yet popped, briefly negative while a push is published
+  size_t pending_;
+  bool stop_;
+  DISALLOW_COPY_AND_ASSIGN(ThreadPool);
+};
+
+// Default worker count for --threads
+int hardware_threads();
+
+#endif //CACHE_THREAD_POOL_H_
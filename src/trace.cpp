@@ -0,0 +1,9 @@
+#include "trace.hpp"
+#include "binary_trace.hpp"
+#include "text_trace.hpp"
+
+bool load_trace(const string &path, vector<TraceRequest> &requests, int threads) {
+  if (is_binary_trace(path))
+    return load_binary_trace(path, requests);
+  return load_text_trace(path, requests, threads);
+}
@@ -0,0 +1,23 @@
+#ifndef CACHE_TRACE_H_
+#define CACHE_TRACE_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Decoded trace request, 'r' is a read and everything else a write
+typedef struct TraceRequest_ {
+  uint64_t addr;
+  uint8_t read; // 0|1 for write|read
+} TraceRequest;
+
+// Parse the whole text or binary trace into memory so it can be replayed for every iteration
+// [in]  path: trace file path
+// [out] requests: decoded requests in trace order
+// [in]  threads: text parser threads, 0 for one per hardware thread
+// Returns false if the trace can't be opened
+bool load_trace(const string &path, vector<TraceRequest> &requests, int threads = 1);
+
+#endif //CACHE_TRACE_H_
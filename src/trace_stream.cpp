@@ -0,0 +1,79 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "trace_stream.hpp"
+#include "text_trace.hpp"
+
+TraceStream::TraceStream() : fd_(-1), full_(STREAM_BUFFERS + 1), free_(STREAM_BUFFERS),
+                             current_(nullptr), failed_(false) {}
+
+TraceStream::~TraceStream() {
+  // Let the reader run to the end of the stream so it never blocks on free_
+  while (Next());
+  if (fd_ > 0)
+    close(fd_);
+}
+
+bool TraceStream::Open(const string &path) {
+  fd_ = path == "-" ? 0 : open(path.c_str(), O_RDONLY);
+  if (fd_ < 0)
+    return false;
+  buffers_.resize(STREAM_BUFFERS);
+  for (auto &buffer: buffers_)
+    free_.Push(&buffer);
+  reader_ = thread([this] { Reader(); });
+  return true;
+}
+
+const vector<TraceRequest> *TraceStream::Next() {
+  if (!reader_.joinable())
+    return nullptr;
+  if (current_)
+    free_.Push(current_);
+  full_.Pop(current_);
+  if (!current_)
+    reader_.join();
+  return current_;
+}
+
+void TraceStream::Reader() {
+  vector<char> text(STREAM_READ_SIZE);
+  size_t len = 0;
+  bool eof = false;
+  while (!eof) {
+    ssize_t n = read(fd_, text.data() + len, text.size() - len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      eof = true;
+    else
+      len += n;
+
+    // Hand over complete lines only, the tail waits for the next read
+    size_t used = len;
+    if (!eof) {
+      while (used > 0 && text[used - 1] != '\n')
+        used--;
+      if (used == 0) {
+        if (len < text.size())
+          continue;
+        failed_ = true; // A line longer than the whole read buffer
+        break;
+      }
+    }
+    if (used == 0)
+      break;
+
+    vector<TraceRequest> *buffer;
+    free_.Pop(buffer);
+    buffer->clear();
+    if (!parse_text_trace(text.data(), text.data() + used, *buffer, best_hex_kernel())) {
+      failed_ = true;
+      break;
+    }
+    full_.Push(buffer);
+    copy(text.begin() + used, text.begin() + len, text.begin());
+    len -= used;
+  }
+  full_.Push(nullptr);
+}
@@ -0,0 +1,47 @@
+#ifndef CACHE_TRACE_STREAM_H_
+#define CACHE_TRACE_STREAM_H_
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include "spsc_ring.hpp"
+#include "trace.hpp"
+
+using namespace std;
+
+#define STREAM_READ_SIZE (1 << 20) // Text bytes parsed into one request buffer
+#define STREAM_BUFFERS 4           // Request buffers in flight
+
+// Reads a text trace from stdin, a FIFO or a file on a background thread.
+// Parsed requests travel to the consumer in a fixed number of buffers
+// through SPSC rings, so memory stays bounded however long the trace is.
+class TraceStream {
+ public:
+  TraceStream();
+  ~TraceStream();
+
+  // path "-" reads stdin
+  bool Open(const string &path);
+
+  // Next buffer of requests or nullptr at the end of the stream, the buffer
+  // stays valid until the following call
+  const vector<TraceRequest> *Next();
+
+  // True if the stream stopped at a malformed line
+  bool Failed() const { return failed_; }
+
+ private:
+  void Reader();
+
+  int fd_;
+  thread reader_;
+  vector<vector<TraceRequest>> buffers_;
+  SpscRing<vector<TraceRequest> *> full_; // Reader -> simulator
+  SpscRing<vector<TraceRequest> *> free_; // Simulator -> reader
+  vector<TraceRequest> *current_;
+  atomic<bool> failed_;
+  DISALLOW_COPY_AND_ASSIGN(TraceStream);
+};
+
+#endif //CACHE_TRACE_STREAM_H_
@@ -0,0 +1,99 @@
+#include "way_lookup.hpp"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#endif
+
+static int lookup_scalar(const uint64_t *tags, const uint64_t *valid, int associativity, uint64_t tag) {
+  for (int i = 0; i < associativity; i++) {
+    if ((valid[i >> 6] >> (i & 63) & 1) && tags[i] == tag)
+      return i;
+  }
+  return -1;
+}
+
+#ifdef HAVE_X86_KERNELS
+
+// Each kernel builds the match mask of up to 64 ways at a time and masks it
+// with the valid word, so the first hit is a single ctz
+
+__attribute__((target("sse4.2")))
+static int lookup_sse42(const uint64_t *tags, const uint64_t *valid, int associativity, uint64_t tag) {
+  if (associativity < 2)
+    return lookup_scalar(tags, valid, associativity, tag);
+  __m128i key = _mm_set1_epi64x(tag);
+  for (int base = 0; base < associativity; base += 64) {
+    int ways = associativity - base < 64 ? associativity - base : 64;
+    uint64_t match = 0;
+    for (int i = 0; i < ways; i += 2) {
+      __m128i v = _mm_loadu_si128((const __m128i *) (tags + base + i));
+      match |= (uint64_t) _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(v, key))) << i;
+    }
+    match &= valid[base >> 6];
+    if (match)
+      return base + __builtin_ctzll(match);
+  }
+  return -1;
+}
+
+__attribute__((target("avx2")))
+static int lookup_avx2(const uint64_t *tags, const uint64_t *valid, int associativity, uint64_t tag) {
+  if (associativity < 4)
+    return lookup_sse42(tags, valid, associativity, tag);
+  __m256i key = _mm256_set1_epi64x(tag);
+  for (int base = 0; base < associativity; base += 64) {
+    int ways = associativity - base < 64 ? associativity - base : 64;
+    uint64_t match = 0;
+    for (int i = 0; i < ways; i += 4) {
+      __m256i v = _mm256_loadu_si256((const __m256i *) (tags + base + i));
+      match |= (uint64_t) _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(v, key))) << i;
+    }
+    match &= valid[base >> 6];
+    if (match)
+      return base + __builtin_ctzll(match);
+  }
+  return -1;
+}
+
+#endif // HAVE_X86_KERNELS
+
+bool lookup_kernel_supported(LookupKernel kernel) {
+  switch (kernel) {
+    case kLookupScalar:
+      return true;
+#ifdef HAVE_X86_KERNELS
+    case kLookupSse42:
+      return __builtin_cpu_supports("sse4.2");
+    case kLookupAvx2:
+      return __builtin_cpu_supports("avx2");
+#endif
+    default:
+      return false;
+  }
+}
+
+LookupKernel best_lookup_kernel() {
+  static const LookupKernel best = lookup_kernel_supported(kLookupAvx2) ? kLookupAvx2 :
+                                   lookup_kernel_supported(kLookupSse42) ? kLookupSse42 : kLookupScalar;
+  return best;
+}
+
+WayLookup way_lookup(LookupKernel kernel) {
+#ifdef HAVE_X86_KERNELS
+  if (kernel == kLookupAvx2)
+    return lookup_avx2;
+  if (kernel == kLookupSse42)
+    return lookup_sse42;
+#endif
+  return lookup_scalar;
+}
+
+const char *lookup_kernel_name(LookupKernel kernel) {
+  switch (kernel) {
+    case kLookupScalar: return "scalar";
+    case kLookupSse42: return "sse4.2";
+    case kLookupAvx2: return "avx2";
+  }
+  return "unknown";
+}
@@ -0,0 +1,27 @@
+#ifndef CACHE_WAY_LOOKUP_H_
+#define CACHE_WAY_LOOKUP_H_
+
+#include <stdint.h>
+
+// Tag match kernels over the contiguous tags of one set
+enum LookupKernel {
+  kLookupScalar,
+  kLookupSse42, // Two ways per compare
+  kLookupAvx2,  // Four ways per compare
+};
+
+// [in] tags: associativity tags of the set
+// [in] valid: valid bit words of the set, way i is bit i % 64 of word i / 64
+// Returns the first valid way holding tag, -1 if none
+typedef int (*WayLookup)(const uint64_t *tags, const uint64_t *valid, int associativity, uint64_t tag);
+
+WayLookup way_lookup(LookupKernel kernel);
+
+bool lookup_kernel_supported(LookupKernel kernel);
+
+// Best kernel supported by the host
+LookupKernel best_lookup_kernel();
+
+const char *lookup_kernel_name(LookupKernel kernel);
+
+#endif //CACHE_WAY_LOOKUP_H_